@@ -0,0 +1,188 @@
+#include <iostream>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "matchingengine.h"
+#include "flowgenerator.h"
+#include "latencyhistogram.h"
+
+//benchmark [--messages=N] [--seed=S] [--mix=buy,sell,modify,cancel,print] [--mid=P]
+//          [--spread=T] [--cross=T] [--ioc=PCT] [--depth=D] [--maxqty=Q] [--reports=null|text|binary]
+//          [--batch=1,16,64,256]
+//generates a seeded flow (see flowgenerator.h), rests --depth orders untimed, then runs
+//the flow on fresh engines: once flat out for messages/sec, once per --batch size
+//decoding that many messages at a time and handing them to processBatch, and once
+//timing every processNextMessage call into a histogram per message type; reports,
+//when not null, are formatted in full and written to /dev/null
+
+namespace
+{
+using bench_clock_t = std::chrono::steady_clock;
+
+bool parseOption(char const * arg, char const * name, char const * & value)
+{
+    auto const length = std::strlen(name);
+    if (std::strncmp(arg, name, length) != 0 || arg[length] != '=') return false;
+    value = arg + length + 1;
+    return true;
+}
+
+bool parseMix(char const * text, unsigned (&weights)[FlowMessageTypes])
+{
+    for (auto t = std::size_t(0); t < FlowMessageTypes; ++t)
+    {
+        auto end = static_cast<char *>(nullptr);
+        weights[t] = static_cast<unsigned>(std::strtoul(text, &end, 10));
+        if (end==text) return false;
+        text = end;
+        if (t + 1 < FlowMessageTypes && *text++ != ',') return false;
+    }
+    return *text=='\0';
+}
+
+bool parseCounts(char const * text, std::vector<std::size_t> & counts)
+{
+    counts.clear();
+    for (;;)
+    {
+        auto end = static_cast<char *>(nullptr);
+        auto const count = std::strtoull(text, &end, 10);
+        if (end==text || count==0) return false;
+        counts.push_back(count);
+        if (*end=='\0') return true;
+        if (*end != ',') return false;
+        text = end + 1;
+    }
+}
+
+std::unique_ptr<ExecutionReportSink> makeSink(char const * reports, std::FILE * output)
+{
+    auto sink = std::unique_ptr<ExecutionReportSink>();
+    if      (std::strcmp(reports, "null")==0)   sink.reset(new NullReportSink());
+    else if (std::strcmp(reports, "text")==0)   sink.reset(new TextReportSink(output));
+    else if (std::strcmp(reports, "binary")==0) sink.reset(new BinaryReportSink(output));
+    return sink;
+}
+
+void warmUp(MatchingEngine & engine, FlowGenerator::Messages const & warmup)
+{
+    for (auto i = std::size_t(0); i < warmup.size(); ++i) engine.processNextMessage(warmup.at(i));
+}
+}
+
+int main(int argc, char ** argv)
+{
+  auto config   = defaultFlowConfig();
+  auto count    = std::size_t(1000000);
+  auto reports  = "null";
+  auto batches  = std::vector<std::size_t>{1, 16, 64, 256};
+  for (auto i = 1; i < argc; ++i)
+  {
+    auto value = static_cast<char const *>(nullptr);
+    auto ok    = true;
+    if      (parseOption(argv[i], "--messages", value)) count              = std::strtoull(value, nullptr, 10);
+    else if (parseOption(argv[i], "--seed", value))     config.Seed        = std::strtoull(value, nullptr, 10);
+    else if (parseOption(argv[i], "--mix", value))      ok                 = parseMix(value, config.Weights);
+    else if (parseOption(argv[i], "--mid", value))      config.Mid         = std::strtoull(value, nullptr, 10);
+    else if (parseOption(argv[i], "--spread", value))   config.Spread      = std::strtoul(value, nullptr, 10);
+    else if (parseOption(argv[i], "--cross", value))    config.Cross       = std::strtoul(value, nullptr, 10);
+    else if (parseOption(argv[i], "--ioc", value))      config.IocPercent  = std::strtoul(value, nullptr, 10);
+    else if (parseOption(argv[i], "--depth", value))    config.Depth       = std::strtoull(value, nullptr, 10);
+    else if (parseOption(argv[i], "--maxqty", value))   config.MaxQuantity = std::strtoul(value, nullptr, 10);
+    else if (parseOption(argv[i], "--reports", value))  reports            = value;
+    else if (parseOption(argv[i], "--batch", value))    ok                 = parseCounts(value, batches);
+    else ok = false;
+    if (!ok)
+    {
+      std::cerr << "bad argument " << argv[i] << std::endl;
+      return 1;
+    }
+  }
+  auto totalWeight = 0u;
+  for (auto w : config.Weights) totalWeight += w;
+  if (totalWeight==0 || config.Mid <= config.Spread || config.MaxQuantity==0)
+  {
+    std::cerr << "need a nonzero mix, a mid above the spread and a nonzero max quantity" << std::endl;
+    return 1;
+  }
+
+  auto devNull = std::fopen("/dev/null", "wb");
+  auto sink    = makeSink(reports, devNull);
+  if (!devNull || !sink)
+  {
+    std::cerr << "unknown report format " << reports << std::endl;
+    return 1;
+  }
+
+  auto generator = FlowGenerator(config);
+  auto const warmup   = generator.warmup();
+  auto const messages = generator.generate(count);
+
+  std::cout << "flow: seed " << config.Seed << " messages " << count << " mix";
+  for (auto t = std::size_t(0); t < FlowMessageTypes; ++t) std::cout << (t ? "/" : " ") << config.Weights[t];
+  std::cout << " mid " << config.Mid << " spread " << config.Spread << " cross " << config.Cross
+  << " ioc " << config.IocPercent << "% depth " << config.Depth << " maxqty " << config.MaxQuantity
+  << " reports " << reports << std::endl;
+
+  {//throughput: nothing but the engine inside the timed loop
+    MatchingEngine engine(*sink);
+    warmUp(engine, warmup);
+    auto const start = bench_clock_t::now();
+    for (auto i = std::size_t(0); i < messages.size(); ++i) engine.processNextMessage(messages.at(i));
+    sink->flush();
+    auto const seconds = std::chrono::duration<double>(bench_clock_t::now() - start).count();
+    std::cout << "throughput: " << messages.size() << " messages in " << seconds << " s, "
+    << static_cast<uint64_t>(messages.size()/seconds) << " msgs/s" << std::endl;
+  }
+  for (auto const batch : batches)
+  {//the same, decoded batch messages at a time and run by processBatch
+    MatchingEngine engine(*sink);
+    warmUp(engine, warmup);
+    auto commands = std::vector<Command>();
+    commands.reserve(batch);
+    auto const start = bench_clock_t::now();
+    for (auto i = std::size_t(0); i < messages.size(); ++i)
+    {
+      commands.push_back(engine.decodeMessage(messages.at(i)));
+      if (commands.size()==batch || i + 1==messages.size())
+      {
+        engine.processBatch(commands.data(), commands.size());
+        commands.clear();
+      }
+    }
+    sink->flush();
+    auto const seconds = std::chrono::duration<double>(bench_clock_t::now() - start).count();
+    std::cout << "batch " << batch << ": " << static_cast<uint64_t>(messages.size()/seconds) << " msgs/s" << std::endl;
+  }
+  {//latency: every call timed on its own, which includes one clock read of overhead
+    MatchingEngine engine(*sink);
+    warmUp(engine, warmup);
+    LatencyHistogram histograms[FlowMessageTypes];
+    for (auto i = std::size_t(0); i < messages.size(); ++i)
+    {
+      auto const message = messages.at(i);
+      auto const start   = bench_clock_t::now();
+      engine.processNextMessage(message);
+      auto const nanos   = std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock_t::now() - start).count();
+      histograms[static_cast<std::size_t>(messages.Types[i])].record(static_cast<uint64_t>(nanos));
+    }
+    sink->flush();
+    printHistogramHeader(std::cout, "latency (ns)");
+    auto all = LatencyHistogram();
+    for (auto t = std::size_t(0); t < FlowMessageTypes; ++t)
+    {
+      if (histograms[t].count()==0) continue;
+      printHistogramRow(std::cout, flowMessageName(static_cast<FlowMessage>(t)), histograms[t]);
+      all.merge(histograms[t]);
+    }
+    printHistogramRow(std::cout, "all", all);
+  }
+
+  sink.reset();
+  std::fclose(devNull);
+  return 0;
+}
@@ -0,0 +1,118 @@
+#ifndef MATCHINGENGINE_BINARYPROTOCOL_H
+#define MATCHINGENGINE_BINARYPROTOCOL_H
+
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "ordertypes.h"
+
+//the binary protocol carries the same messages as the text one, but every
+//message is one fixed-size little-endian record, so there is nothing to tokenize
+//
+//  offset size field
+//       0    1 type        (CommandType)
+//       1    1 side        (OrderSide; BUY/SELL/MODIFY)
+//       2    1 tif         (TimeInForce; BUY/SELL)
+//       3    1 reserved    (zero)
+//       4    4 order handle (BUY/SELL/MODIFY/CANCEL)
+//       8    8 price        (BUY/SELL/MODIFY)
+//      16    8 quantity     (BUY/SELL/MODIFY)
+//
+//fields a message type doesn't use are written as zero and ignored on decode
+
+enum class CommandType : uint8_t {Buy = 1, Sell = 2, Modify = 3, Cancel = 4, Print = 5, Stats = 6, EndOfDay = 7,
+                                  Auction = 8, Uncross = 9};
+
+struct Command
+{//a fully decoded message; both protocols end up here before reaching the book
+    CommandType    Type;
+    OrderSide      Side;
+    TimeInForce    TIF;
+    order_handle_t OrderHandle;
+    uint64_t       Price;
+    uint64_t       Quantity;
+};
+
+struct BinaryCodec
+{
+    static constexpr std::size_t RecordSize = 24;
+
+    static void encode(Command const & command, unsigned char * record)
+    {
+        record[0] = static_cast<unsigned char>(command.Type);
+        record[1] = static_cast<unsigned char>(command.Side);
+        record[2] = static_cast<unsigned char>(command.TIF);
+        record[3] = 0;
+        store(record +  4, command.OrderHandle, 4);
+        store(record +  8, command.Price,       8);
+        store(record + 16, command.Quantity,    8);
+    }
+    static Command decode(unsigned char const * record)
+    {
+        auto command        = Command();
+        command.Type        = static_cast<CommandType>(record[0]);
+        command.Side        = static_cast<OrderSide>(record[1]);
+        command.TIF         = static_cast<TimeInForce>(record[2]);
+        command.OrderHandle = static_cast<order_handle_t>(load(record + 4, 4));
+        command.Price       = load(record +  8, 8);
+        command.Quantity    = load(record + 16, 8);
+        return command;
+    }
+private:
+    //byte-at-a-time so the format doesn't depend on host endianness;
+    //on little-endian targets the compiler folds these into plain loads/stores
+    static void store(unsigned char * out, uint64_t value, std::size_t width)
+    {
+        for (auto i = std::size_t(0); i < width; ++i) out[i] = static_cast<unsigned char>(value >> (8*i));
+    }
+    static uint64_t load(unsigned char const * in, std::size_t width)
+    {
+        auto value = uint64_t(0);
+        for (auto i = std::size_t(0); i < width; ++i) value |= uint64_t(in[i]) << (8*i);
+        return value;
+    }
+};
+
+struct BinaryMessageReader
+{//hands out records straight from a large reusable buffer; a record pointer is
+    //only valid until the next call, same as MessageReader's tokens
+    static constexpr std::size_t DefaultRecordsPerRead = 1 << 15;
+
+    bool nextRecord(unsigned char const * & record)
+    {
+        if (mEnd - mBegin < BinaryCodec::RecordSize && !refill()) return false;
+        record  = mBuffer.data() + mBegin;
+        mBegin += BinaryCodec::RecordSize;
+        return true;
+    }
+
+    explicit BinaryMessageReader(std::FILE * input, std::size_t recordsPerRead = DefaultRecordsPerRead)
+    :mInput(input), mBuffer(recordsPerRead*BinaryCodec::RecordSize), mBegin(0), mEnd(0){}
+    BinaryMessageReader(BinaryMessageReader const &)             = delete;
+    BinaryMessageReader & operator=(BinaryMessageReader const &) = delete;
+    ~BinaryMessageReader(){}
+private:
+    bool refill()
+    {//a truncated trailing record is dropped
+        auto const partial = mEnd - mBegin;
+        if (partial != 0) std::memmove(mBuffer.data(), mBuffer.data() + mBegin, partial);
+        mBegin = 0;
+        mEnd   = partial;
+        for (;;)
+        {
+            auto const bytesRead = std::fread(mBuffer.data() + mEnd, 1, mBuffer.size() - mEnd, mInput);
+            mEnd += bytesRead;
+            if (mEnd >= BinaryCodec::RecordSize) return true;
+            if (bytesRead==0) return false;
+        }
+    }
+
+    std::FILE *                mInput;
+    std::vector<unsigned char> mBuffer;
+    std::size_t                mBegin;
+    std::size_t                mEnd;
+};
+
+#endif
@@ -0,0 +1,326 @@
+#ifndef MATCHINGENGINE_BOOKSIDES_H
+#define MATCHINGENGINE_BOOKSIDES_H
+
+#include <vector>
+#include <map>
+#include <functional>
+#include <algorithm>
+#include <memory>
+#include <cstdint>
+
+#include "objectsemantics.h"
+#include "ordertypes.h"
+#include "noderecycler.h"
+
+//a book side owns the price levels for one side of the book; OrderBook picks
+//which implementation to use at compile time (see orderbook.h), so both expose
+//the same interface:
+//  empty()                  no levels at all
+//  bestPrice(), bestLevel() the most aggressive level; only valid when !empty()
+//  levelAt(price)           find or create the level at price
+//  findLevel(price)         the level at price, or nullptr
+//  eraseLevel(price)        drop the level at price (and its orders, if any)
+//  forEachLevel(fn)         fn(price, level) from best to worst
+//  forEachLevelWhile(fn)    the same, stopping as soon as fn returns false
+//  forEachLevelReverse(fn)  fn(price, level) from worst to best
+//  prefetchLevel(price)     a hint that the level at price is about to be used
+//  clear()                  drop every level at once, O(1); nothing is asked of the levels' orders
+//  levels()                 how many levels there are, O(1)
+//  memory()                 what the levels take, up front and per level (BookSideMemory)
+//"best" is decided by Compare: std::greater for bids, std::less for asks
+//levels kept in a std::map get their nodes from the side's own NodeRecycler, so an
+//emptied level's node is reused by the next one opened, and clear() hands them all
+//back in one step instead of freeing the tree (see noderecycler.h)
+
+struct BookSideMemory
+{
+    std::size_t   FixedBytes; //allocated with the side, whether used or not: a ladder's array and bitmap
+    std::size_t   LevelBytes; //per level: a ladder slot, or a map node once one has been made
+    std::size_t   Levels;     //live
+    RecyclerStats Nodes;      //the map's nodes; a ladder's are for prices outside the band
+};
+
+inline std::ostream & operator<<(std::ostream & os, BookSideMemory const & memory)
+{
+    return os << "levels " << memory.Levels << " level bytes " << memory.LevelBytes
+              << " fixed bytes " << memory.FixedBytes << ", nodes " << memory.Nodes;
+}
+
+struct PriceBand
+{//the prices a ladder book side keeps in its dense array; anything outside goes sparse
+    price_t     Low;
+    std::size_t Ticks;
+};
+
+#ifndef MATCHINGENGINE_LADDER_LOW
+#define MATCHINGENGINE_LADDER_LOW   0
+#endif
+#ifndef MATCHINGENGINE_LADDER_TICKS
+#define MATCHINGENGINE_LADDER_TICKS (1 << 16)
+#endif
+
+inline PriceBand defaultPriceBand()
+{
+    return PriceBand{MATCHINGENGINE_LADDER_LOW, MATCHINGENGINE_LADDER_TICKS};
+}
+
+template <typename Level, typename Compare>
+struct MapBookSide
+{//the original layout: one tree node per price level
+    using level_map_t = std::map<price_t, Level, Compare, RecyclingAllocator<std::pair<price_t const, Level>>>;
+
+    bool    empty()     const {return mLevels.empty();}
+    price_t bestPrice() const {return mLevels.begin()->first;}
+    Level * bestLevel()       {return &mLevels.begin()->second;}
+    Level & levelAt(price_t price) {return mLevels[price];}
+    Level * findLevel(price_t price)
+    {
+        auto const iter = mLevels.find(price);
+        return (iter==mLevels.end()) ? nullptr : &iter->second;
+    }
+    Level const * findLevel(price_t price) const
+    {
+        auto const iter = mLevels.find(price);
+        return (iter==mLevels.end()) ? nullptr : &iter->second;
+    }
+    void eraseLevel(price_t price) {mLevels.erase(price);}
+    void prefetchLevel(price_t) const {} //finding the node is the miss, so there's nothing cheap to fetch ahead
+    void clear() {recycleAll(mLevels, *mRecycler);}
+    std::size_t levels() const {return mLevels.size();}
+    BookSideMemory memory() const
+    {
+        auto const & nodes = mLevels.get_allocator().stats();
+        return BookSideMemory{0, nodes.NodeSize, mLevels.size(), nodes};
+    }
+    template <typename Fn>
+    void forEachLevel(Fn && fn) const
+    {
+        for (auto iter = mLevels.begin(); iter != mLevels.end(); ++iter) fn(iter->first, iter->second);
+    }
+    template <typename Fn>
+    void forEachLevelWhile(Fn && fn) const
+    {
+        for (auto iter = mLevels.begin(); iter != mLevels.end(); ++iter) if (!fn(iter->first, iter->second)) return;
+    }
+    template <typename Fn>
+    void forEachLevelReverse(Fn && fn) const
+    {
+        for (auto iter = mLevels.rbegin(); iter != mLevels.rend(); ++iter) fn(iter->first, iter->second);
+    }
+
+    explicit MapBookSide(PriceBand = defaultPriceBand())
+    :mRecycler(new NodeRecycler()), mLevels(Compare(), typename level_map_t::allocator_type(*mRecycler)){}
+    MapBookSide(MapBookSide const &)             = delete;
+    MapBookSide & operator=(MapBookSide const &) = delete;
+    MapBookSide(MapBookSide&&)                   = default;
+    MapBookSide & operator=(MapBookSide && other)
+    {//our levels go back to our recycler before it goes
+        mLevels   = std::move(other.mLevels);
+        mRecycler = std::move(other.mRecycler);
+        return *this;
+    }
+    ~MapBookSide(){}
+private:
+    std::unique_ptr<NodeRecycler> mRecycler; //before the map, so it outlives the map's nodes
+    level_map_t                   mLevels;
+};
+
+template <typename Level, typename Compare>
+struct LadderBookSide
+{//levels inside the band live in one contiguous array indexed by tick, with an
+    //occupancy bitmap so finding the next best level is a word scan rather than
+    //a walk over empty slots; the best ladder index is cached so matching and
+    //resting at the touch are O(1); prices outside the band fall back to a map
+
+    bool    empty()     const {return mLadderLevels==0 && mSparse.empty();}
+    price_t bestPrice() const
+    {
+        if (mLadderLevels==0) return mSparse.begin()->first;
+        auto const ladderBest = priceAt(mBestIndex);
+        if (mSparse.empty() || Compare()(ladderBest, mSparse.begin()->first)) return ladderBest;
+        return mSparse.begin()->first;
+    }
+    Level * bestLevel() {return &levelAt(bestPrice());}
+    Level & levelAt(price_t price)
+    {
+        if (!inBand(price)) return mSparse[price];
+        auto const index = indexOf(price);
+        if (!occupied(index))
+        {//a slot left over from before a clear() may still hold its old level
+            mLadder[index] = Level();
+            setOccupied(index);
+            if (mLadderLevels==0 || better(index, mBestIndex)) mBestIndex = index;
+            ++mLadderLevels;
+        }
+        return mLadder[index];
+    }
+    Level * findLevel(price_t price)
+    {
+        return const_cast<Level *>(static_cast<LadderBookSide const *>(this)->findLevel(price));
+    }
+    Level const * findLevel(price_t price) const
+    {
+        if (!inBand(price))
+        {
+            auto const iter = mSparse.find(price);
+            return (iter==mSparse.end()) ? nullptr : &iter->second;
+        }
+        auto const index = indexOf(price);
+        return occupied(index) ? &mLadder[index] : nullptr;
+    }
+    void eraseLevel(price_t price)
+    {
+        if (!inBand(price)) {mSparse.erase(price); return;}
+        auto const index = indexOf(price);
+        if (!occupied(index)) return;
+        mLadder[index] = Level();
+        clearOccupied(index);
+        if (--mLadderLevels != 0 && index==mBestIndex) mBestIndex = nextWorse(index);
+    }
+    void clear()
+    {//only the occupancy bitmap is wiped (one bit per tick), never the levels
+        //themselves, whatever was resting in them; levels outside the band go back to
+        //the recycler in one step
+        std::fill(mOccupied.begin(), mOccupied.end(), uint64_t(0));
+        mLadderLevels = 0;
+        recycleAll(mSparse, *mRecycler);
+    }
+    std::size_t levels() const {return mLadderLevels + mSparse.size();}
+    BookSideMemory memory() const
+    {
+        auto const fixedBytes = mLadder.capacity()*sizeof(Level) + mOccupied.capacity()*sizeof(uint64_t);
+        return BookSideMemory{fixedBytes, sizeof(Level), mLadderLevels + mSparse.size(), mSparse.get_allocator().stats()};
+    }
+    void prefetchLevel(price_t price) const
+    {//the level and its occupancy word; out of band prices are left to the map
+        if (!inBand(price)) return;
+        auto const index = indexOf(price);
+        __builtin_prefetch(&mLadder[index]);
+        __builtin_prefetch(&mOccupied[index/64]);
+    }
+    template <typename Fn>
+    void forEachLevel(Fn && fn) const
+    {
+        forEachLevelWhile([&fn](price_t price, Level const & level){fn(price, level); return true;});
+    }
+    template <typename Fn>
+    void forEachLevelWhile(Fn && fn) const
+    {//merge the ladder and the sparse levels; they never share a price
+        auto sparseIter  = mSparse.begin();
+        auto ladderIndex = (mLadderLevels==0) ? NoIndex : mBestIndex;
+        while (ladderIndex != NoIndex || sparseIter != mSparse.end())
+        {
+            if (sparseIter==mSparse.end() ||
+                (ladderIndex != NoIndex && Compare()(priceAt(ladderIndex), sparseIter->first)))
+            {
+                if (!fn(priceAt(ladderIndex), mLadder[ladderIndex])) return;
+                ladderIndex = nextWorse(ladderIndex);
+            }
+            else
+            {
+                if (!fn(sparseIter->first, sparseIter->second)) return;
+                ++sparseIter;
+            }
+        }
+    }
+    template <typename Fn>
+    void forEachLevelReverse(Fn && fn) const
+    {
+        auto sparseIter  = mSparse.rbegin();
+        auto ladderIndex = (mLadderLevels==0) ? NoIndex : worstIndex();
+        while (ladderIndex != NoIndex || sparseIter != mSparse.rend())
+        {
+            if (sparseIter==mSparse.rend() ||
+                (ladderIndex != NoIndex && Compare()(sparseIter->first, priceAt(ladderIndex))))
+            {
+                fn(priceAt(ladderIndex), mLadder[ladderIndex]);
+                ladderIndex = nextBetter(ladderIndex);
+            }
+            else
+            {
+                fn(sparseIter->first, sparseIter->second);
+                ++sparseIter;
+            }
+        }
+    }
+
+    explicit LadderBookSide(PriceBand band = defaultPriceBand())
+    :mBand(band), mLadder(band.Ticks), mOccupied((band.Ticks + 63)/64, 0),
+    mLadderLevels(0), mBestIndex(0), mRecycler(new NodeRecycler()),
+    mSparse(Compare(), typename sparse_map_t::allocator_type(*mRecycler)){}
+    LadderBookSide(LadderBookSide const &)             = delete;
+    LadderBookSide & operator=(LadderBookSide const &) = delete;
+    LadderBookSide(LadderBookSide&&)                   = default;
+    LadderBookSide & operator=(LadderBookSide && other)
+    {//the sparse levels go back to our recycler before it goes
+        mBand         = other.mBand;
+        mLadder       = std::move(other.mLadder);
+        mOccupied     = std::move(other.mOccupied);
+        mLadderLevels = other.mLadderLevels;
+        mBestIndex    = other.mBestIndex;
+        mSparse       = std::move(other.mSparse);
+        mRecycler     = std::move(other.mRecycler);
+        return *this;
+    }
+    ~LadderBookSide(){}
+private:
+    using sparse_map_t = std::map<price_t, Level, Compare, RecyclingAllocator<std::pair<price_t const, Level>>>;
+
+    static constexpr std::size_t NoIndex = std::size_t(-1);
+
+    //bids get better as the index rises, asks as it falls
+    static bool higherIsBetter() {return Compare()(1, 0);}
+    static bool better(std::size_t a, std::size_t b) {return higherIsBetter() ? (a > b) : (a < b);}
+
+    bool        inBand(price_t price)         const {return price >= mBand.Low && price - mBand.Low < mBand.Ticks;}
+    std::size_t indexOf(price_t price)        const {return static_cast<std::size_t>(price - mBand.Low);}
+    price_t     priceAt(std::size_t index)    const {return mBand.Low + index;}
+    bool        occupied(std::size_t index)   const {return (mOccupied[index/64] >> (index%64)) & 1;}
+    void        setOccupied(std::size_t index)      {mOccupied[index/64] |=  (uint64_t(1) << (index%64));}
+    void        clearOccupied(std::size_t index)    {mOccupied[index/64] &= ~(uint64_t(1) << (index%64));}
+
+    std::size_t nextWorse(std::size_t index)  const {return higherIsBetter() ? nextBelow(index) : nextAbove(index);}
+    std::size_t nextBetter(std::size_t index) const {return higherIsBetter() ? nextAbove(index) : nextBelow(index);}
+    std::size_t worstIndex() const
+    {
+        if (higherIsBetter()) return occupied(0) ? 0 : nextAbove(0);
+        return occupied(mBand.Ticks - 1) ? mBand.Ticks - 1 : nextBelow(mBand.Ticks - 1);
+    }
+    std::size_t nextAbove(std::size_t index) const
+    {//first occupied index strictly above index
+        if (++index >= mBand.Ticks) return NoIndex;
+        auto word = index/64;
+        auto bits = mOccupied[word] & (~uint64_t(0) << (index%64));
+        while (bits==0)
+        {
+            if (++word==mOccupied.size()) return NoIndex;
+            bits = mOccupied[word];
+        }
+        return word*64 + __builtin_ctzll(bits);
+    }
+    std::size_t nextBelow(std::size_t index) const
+    {//first occupied index strictly below index
+        if (index==0) return NoIndex;
+        --index;
+        auto word = index/64;
+        auto bits = mOccupied[word] & (~uint64_t(0) >> (63 - index%64));
+        while (bits==0)
+        {
+            if (word==0) return NoIndex;
+            bits = mOccupied[--word];
+        }
+        return word*64 + 63 - __builtin_clzll(bits);
+    }
+
+    PriceBand                        mBand;
+    std::vector<Level>               mLadder;
+    std::vector<uint64_t>            mOccupied;
+    std::size_t                      mLadderLevels;
+    std::size_t                      mBestIndex;
+    std::unique_ptr<NodeRecycler>    mRecycler; //before the map, so it outlives the map's nodes
+    sparse_map_t                     mSparse;
+};
+template <typename Level, typename Compare>
+constexpr std::size_t LadderBookSide<Level, Compare>::NoIndex;
+
+#endif
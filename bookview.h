@@ -0,0 +1,117 @@
+#ifndef MATCHINGENGINE_BOOKVIEW_H
+#define MATCHINGENGINE_BOOKVIEW_H
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+
+#include "objectsemantics.h"
+#include "ordertypes.h"
+#include "orderbook.h"
+
+//the top of the book for other threads (risk, market data, monitoring) to read
+//while matching carries on: the matching thread publishes the best levels of each
+//side into a seqlock, and any number of readers copy them out
+//
+//publishing makes the sequence odd, writes the levels and makes it even again;
+//a reader copies the levels between two loads of the sequence, and tries again if
+//they differ or were odd. The writer never waits for a reader, never allocates,
+//and reads nothing a reader writes, so readers can't hold matching up; every word
+//is a relaxed atomic, so a copy torn by a publish is well defined, and thrown away
+
+struct BookView
+{//a reader's copy of the view; sized for the view's depth up front, so reading
+    //into it never allocates
+    uint64_t                   Messages; //messages the engine had processed when it was published
+    std::vector<LevelSnapshot> Bids;     //best first
+    std::vector<LevelSnapshot> Asks;
+
+    explicit BookView(std::size_t depth = 0):Messages(0), Bids(), Asks()
+    {
+        Bids.reserve(depth);
+        Asks.reserve(depth);
+    }
+    DEFAULT_OBJECT_SEMANTICS(BookView)
+    ~BookView(){}
+};
+
+struct SeqlockBookView
+{
+    //writer: the matching thread alone
+    template <typename Book>
+    void publish(Book const & book, uint64_t messages)
+    {//anything with OrderBook's snapshot(side, levels, depth)
+        auto const bids = book.snapshot(OrderSide::Buy,  mScratch.data(),          mDepth);
+        auto const asks = book.snapshot(OrderSide::Sell, mScratch.data() + mDepth, mDepth);
+        auto const sequence = mSequence.load(std::memory_order_relaxed);
+        mSequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release); //the odd sequence is seen before any new level
+        store(MessagesWord, messages);
+        store(BidsWord, bids);
+        store(AsksWord, asks);
+        for (auto i = std::size_t(0); i < bids; ++i) storeLevel(i, mScratch[i]);
+        for (auto i = std::size_t(0); i < asks; ++i) storeLevel(mDepth + i, mScratch[mDepth + i]);
+        mSequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    //readers: any thread, any number of them
+    bool tryRead(BookView & view) const
+    {//one attempt; false if a publish got in the way, and view is then unspecified
+        auto const before = mSequence.load(std::memory_order_acquire);
+        if (before & 1) return false;
+        view.Messages   = load(MessagesWord);
+        auto const bids = load(BidsWord);
+        auto const asks = load(AsksWord);
+        if (bids > mDepth || asks > mDepth) return false; //torn counts; the sequence check would fail anyway
+        view.Bids.resize(bids);
+        view.Asks.resize(asks);
+        for (auto i = std::size_t(0); i < bids; ++i) view.Bids[i] = loadLevel(i);
+        for (auto i = std::size_t(0); i < asks; ++i) view.Asks[i] = loadLevel(mDepth + i);
+        std::atomic_thread_fence(std::memory_order_acquire); //every level is read before the sequence again
+        return mSequence.load(std::memory_order_relaxed)==before;
+    }
+    uint64_t read(BookView & view) const
+    {//tries until it gets a consistent copy; returns how many attempts failed first
+        auto retries = uint64_t(0);
+        while (!tryRead(view)) ++retries;
+        return retries;
+    }
+    std::size_t depth() const {return mDepth;}
+
+    //depth is how many levels of each side are published
+    explicit SeqlockBookView(std::size_t depth)
+    :mSequence(0), mPad(), mDepth(depth), mWords(HeaderWords + 2*depth*LevelWords), mScratch(2*depth){}
+    SeqlockBookView(SeqlockBookView const &)             = delete; //readers on other threads hold on to it
+    SeqlockBookView & operator=(SeqlockBookView const &) = delete;
+    ~SeqlockBookView(){}
+private:
+    static constexpr std::size_t MessagesWord = 0;
+    static constexpr std::size_t BidsWord     = 1;
+    static constexpr std::size_t AsksWord     = 2;
+    static constexpr std::size_t HeaderWords  = 3;
+    static constexpr std::size_t LevelWords   = 3; //price, quantity, orders
+    static constexpr std::size_t CacheLine    = 64;
+
+    void     store(std::size_t word, uint64_t value) {mWords[word].store(value, std::memory_order_relaxed);}
+    uint64_t load(std::size_t word) const            {return mWords[word].load(std::memory_order_relaxed);}
+    void storeLevel(std::size_t level, LevelSnapshot const & snapshot)
+    {//levels are numbered bids first, then asks
+        auto const word = HeaderWords + level*LevelWords;
+        store(word,     snapshot.Price);
+        store(word + 1, snapshot.Quantity);
+        store(word + 2, snapshot.Orders);
+    }
+    LevelSnapshot loadLevel(std::size_t level) const
+    {
+        auto const word = HeaderWords + level*LevelWords;
+        return LevelSnapshot{load(word), load(word + 1), load(word + 2)};
+    }
+
+    std::atomic<uint64_t>              mSequence; //odd while a publish is under way
+    char                               mPad[CacheLine];
+    std::size_t                        mDepth;
+    std::vector<std::atomic<uint64_t>> mWords;   //header, then the levels
+    std::vector<LevelSnapshot>         mScratch; //the writer's: bids then asks, as the book gave them
+};
+
+#endif
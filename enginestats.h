@@ -0,0 +1,79 @@
+#ifndef MATCHINGENGINE_ENGINESTATS_H
+#define MATCHINGENGINE_ENGINESTATS_H
+
+#include <iostream>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+#include "objectsemantics.h"
+#include "latencyhistogram.h"
+
+//hot-path instrumentation, compiled in only with MATCHINGENGINE_STATS defined
+//(make STATS=1); otherwise every MATCHINGENGINE_STAT(...) vanishes, and so do
+//BookStats and the engine's per message histograms, so a book or engine built
+//without them carries no storage for them (which adds up with a book per symbol)
+
+#ifdef MATCHINGENGINE_STATS
+#define MATCHINGENGINE_STAT(statement) statement
+constexpr bool StatsEnabled = true;
+#else
+#define MATCHINGENGINE_STAT(statement)
+constexpr bool StatsEnabled = false;
+#endif
+
+inline uint64_t readTicks()
+{//the time stamp counter where there is one: a few cycles to read, no syscall
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+#ifdef MATCHINGENGINE_STATS
+struct BookStats
+{
+    LatencyHistogram LevelsWalked;  //levels matched against per tryMatchOrder
+    LatencyHistogram OrdersTouched; //book orders filled or partly filled per matchOrder
+    LatencyHistogram RetrieveTicks; //per retrieveOrderInLevelOrders
+    uint64_t         LevelsCreated;
+    uint64_t         LevelsErased;
+    uint64_t         PeakLevels;    //most levels live at once, both sides together
+    uint64_t         ModifiesInPlace;  //size-downs amended where they rest, keeping priority
+    uint64_t         ModifiesReplaced; //modifies done as cancel/replace
+
+    void levelCreated()
+    {
+        ++LevelsCreated;
+        if (LevelsCreated - LevelsErased > PeakLevels) PeakLevels = LevelsCreated - LevelsErased;
+    }
+    void levelErased() {++LevelsErased;}
+    void levelsErased(uint64_t levels) {LevelsErased += levels;}
+
+    BookStats():LevelsWalked(), OrdersTouched(), RetrieveTicks(), LevelsCreated(0), LevelsErased(0), PeakLevels(0),
+    ModifiesInPlace(0), ModifiesReplaced(0){}
+    DEFAULT_OBJECT_SEMANTICS(BookStats)
+    ~BookStats(){}
+};
+
+inline std::ostream & operator<<(std::ostream & os, BookStats const & stats)
+{
+    printHistogramHeader(os, "book");
+    printHistogramRow(os, "levels/match", stats.LevelsWalked);
+    printHistogramRow(os, "orders/level", stats.OrdersTouched);
+    printHistogramRow(os, "retrieve(t)",  stats.RetrieveTicks);
+    return os << "levels created " << stats.LevelsCreated
+              << " erased "        << stats.LevelsErased
+              << " live "          << stats.LevelsCreated - stats.LevelsErased
+              << " peak "          << stats.PeakLevels << std::endl
+              << "modifies in place " << stats.ModifiesInPlace
+              << " replaced "         << stats.ModifiesReplaced << std::endl;
+}
+#endif
+
+#endif
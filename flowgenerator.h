@@ -0,0 +1,208 @@
+#ifndef MATCHINGENGINE_FLOWGENERATOR_H
+#define MATCHINGENGINE_FLOWGENERATOR_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "objectsemantics.h"
+#include "messagereader.h"
+#include "ordertypes.h"
+
+//a seeded, synthetic order flow in the text protocol; the same FlowConfig always
+//produces the same messages, on any platform, so benchmark runs are comparable
+
+enum class FlowMessage : uint8_t {Buy = 0, Sell = 1, Modify = 2, Cancel = 3, Print = 4};
+
+constexpr std::size_t FlowMessageTypes = 5;
+
+inline char const * flowMessageName(FlowMessage type)
+{
+    static char const * const names[FlowMessageTypes] = {"BUY", "SELL", "MODIFY", "CANCEL", "PRINT"};
+    return names[static_cast<std::size_t>(type)];
+}
+
+struct FlowConfig
+{
+    uint64_t    Seed;
+    unsigned    Weights[FlowMessageTypes]; //relative frequency, indexed by FlowMessage
+    price_t     Mid;
+    unsigned    Spread;      //passive prices sit up to this many ticks away from the mid, on their own side
+    unsigned    Cross;       //and aggressive ones up to this many ticks through it
+    unsigned    IocPercent;  //share of new orders sent IOC rather than GFD
+    std::size_t Depth;       //orders resting before measurement starts; past this many, new orders give way to cancels
+    unsigned    MaxQuantity;
+};
+
+inline FlowConfig defaultFlowConfig()
+{//a cancel-heavy flow, roughly the shape of a real book
+    return FlowConfig{1, {30, 30, 10, 29, 1}, 10000, 50, 5, 10, 1000, 100};
+}
+
+struct FlowRandom
+{//xorshift64*: fast and, unlike <random>'s distributions, the same everywhere
+    uint64_t next()
+    {
+        mState ^= mState >> 12;
+        mState ^= mState << 25;
+        mState ^= mState >> 27;
+        return mState*2685821657736338717ull;
+    }
+    uint64_t below(uint64_t bound) {return static_cast<uint64_t>((static_cast<unsigned __int128>(next() >> 32)*bound) >> 32);}
+
+    explicit FlowRandom(uint64_t seed):mState(seed*0x9E3779B97F4A7C15ull | 1){}
+private:
+    uint64_t mState;
+};
+
+struct ZipfDistribution
+{//rank r (from 0) is drawn with weight 1/(r + 1)^exponent, so a few ranks get
+    //most of the draws; a binary search over the cumulative weights per draw
+    std::size_t operator()(FlowRandom & random) const
+    {
+        auto const u = static_cast<double>(random.next() >> 11)*(1.0/9007199254740992.0)*mCumulative.back();
+        auto const rank = std::upper_bound(mCumulative.begin(), mCumulative.end(), u) - mCumulative.begin();
+        return static_cast<std::size_t>(rank) < mCumulative.size() ? static_cast<std::size_t>(rank) : mCumulative.size() - 1;
+    }
+
+    ZipfDistribution(std::size_t ranks, double exponent):mCumulative()
+    {
+        mCumulative.reserve(ranks);
+        auto total = 0.0;
+        for (auto r = std::size_t(0); r < ranks; ++r)
+        {
+            total += 1.0/std::pow(static_cast<double>(r + 1), exponent);
+            mCumulative.push_back(total);
+        }
+    }
+    DEFAULT_OBJECT_SEMANTICS(ZipfDistribution)
+    ~ZipfDistribution(){}
+private:
+    std::vector<double> mCumulative;
+};
+
+struct FlowGenerator
+{//messages are generated up front into one buffer, so that producing them is
+    //never part of what gets measured; warmup() fills the book to the requested depth
+    struct Messages
+    {
+        std::vector<char>        Text;    //every message back to back, no newlines
+        std::vector<std::size_t> Offsets; //Offsets[i] to Offsets[i+1] is message i
+        std::vector<FlowMessage> Types;
+
+        std::size_t size() const {return Types.size();}
+        Token at(std::size_t i) const {return Token(Text.data() + Offsets[i], Offsets[i + 1] - Offsets[i]);}
+    };
+
+    Messages warmup()
+    {//passive GFD orders only, so nothing trades and all of them rest
+        auto messages = Messages();
+        messages.Offsets.push_back(0);
+        for (auto i = std::size_t(0); i < mConfig.Depth; ++i)
+        {
+            auto const side = mRandom.below(2)==0 ? FlowMessage::Buy : FlowMessage::Sell;
+            addNewOrder(messages, side, false, passivePrice(side));
+        }
+        return messages;
+    }
+    Messages generate(std::size_t count)
+    {
+        auto messages = Messages();
+        messages.Offsets.reserve(count + 1);
+        messages.Types.reserve(count);
+        messages.Offsets.push_back(0);
+        for (auto i = std::size_t(0); i < count; ++i)
+        {
+            auto type = pickType();
+            if      ((type==FlowMessage::Modify || type==FlowMessage::Cancel) && mLiveIds.empty()) type = FlowMessage::Buy;
+            else if ((type==FlowMessage::Buy || type==FlowMessage::Sell) && mLiveIds.size() > mConfig.Depth) type = FlowMessage::Cancel;
+            switch (type)
+            {
+                case FlowMessage::Buy:
+                case FlowMessage::Sell:
+                    addNewOrder(messages, type, mRandom.below(100) < mConfig.IocPercent, price(type));
+                    break;
+                case FlowMessage::Modify:
+                {
+                    auto const side = mRandom.below(2)==0 ? FlowMessage::Buy : FlowMessage::Sell;
+                    mLine = "MODIFY " + pickId() + (side==FlowMessage::Buy ? " BUY " : " SELL ") +
+                            std::to_string(price(side)) + " " + std::to_string(quantity());
+                    add(messages, type);
+                    break;
+                }
+                case FlowMessage::Cancel:
+                    mLine = "CANCEL " + takeId();
+                    add(messages, type);
+                    break;
+                case FlowMessage::Print:
+                    mLine = "PRINT";
+                    add(messages, type);
+                    break;
+            }
+        }
+        return messages;
+    }
+
+    explicit FlowGenerator(FlowConfig const & config)
+    :mConfig(config), mRandom(config.Seed), mLiveIds(), mNextId(0), mLine(){}
+    DEFAULT_OBJECT_SEMANTICS(FlowGenerator)
+    ~FlowGenerator(){}
+private:
+    FlowMessage pickType()
+    {
+        auto total = uint64_t(0);
+        for (auto w : mConfig.Weights) total += w;
+        auto pick = mRandom.below(total);
+        for (auto t = std::size_t(0); t < FlowMessageTypes; ++t)
+        {
+            if (pick < mConfig.Weights[t]) return static_cast<FlowMessage>(t);
+            pick -= mConfig.Weights[t];
+        }
+        return FlowMessage::Print;
+    }
+    price_t passivePrice(FlowMessage side)
+    {
+        auto const away = 1 + mRandom.below(mConfig.Spread);
+        return (side==FlowMessage::Buy) ? mConfig.Mid - away : mConfig.Mid + away;
+    }
+    price_t price(FlowMessage side)
+    {//uniform over [mid - Cross, mid + Spread] on the order's own side of the mid
+        auto const offset = static_cast<int64_t>(mRandom.below(mConfig.Spread + mConfig.Cross + 1)) - mConfig.Cross;
+        return (side==FlowMessage::Buy) ? mConfig.Mid - offset : mConfig.Mid + offset;
+    }
+    uint64_t quantity() {return 1 + mRandom.below(mConfig.MaxQuantity);}
+    void addNewOrder(Messages & messages, FlowMessage side, bool ioc, price_t price)
+    {
+        auto const id = "o" + std::to_string(mNextId++);
+        mLine = std::string(side==FlowMessage::Buy ? "BUY " : "SELL ") + (ioc ? "IOC " : "GFD ") +
+                std::to_string(price) + " " + std::to_string(quantity()) + " " + id;
+        add(messages, side);
+        //ids that have since traded away stay candidates; cancelling them is part of real flow too
+        if (!ioc) mLiveIds.push_back(id);
+    }
+    std::string const & pickId() {return mLiveIds[mRandom.below(mLiveIds.size())];}
+    std::string takeId()
+    {
+        auto const i  = mRandom.below(mLiveIds.size());
+        auto const id = mLiveIds[i];
+        mLiveIds[i]   = mLiveIds.back();
+        mLiveIds.pop_back();
+        return id;
+    }
+    void add(Messages & messages, FlowMessage type)
+    {
+        messages.Text.insert(messages.Text.end(), mLine.begin(), mLine.end());
+        messages.Offsets.push_back(messages.Text.size());
+        messages.Types.push_back(type);
+    }
+
+    FlowConfig               mConfig;
+    FlowRandom               mRandom;
+    std::vector<std::string> mLiveIds; //GFD ids not cancelled yet, which cancels and modifies choose from
+    uint64_t                 mNextId;
+    std::string              mLine;    //scratch for the message being built
+};
+
+#endif
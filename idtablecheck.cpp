@@ -0,0 +1,245 @@
+#include <iostream>
+#include <string>
+#include <cstdlib>
+
+#include "orderindex.h"
+#include "matchingengine.h"
+#include "pipeline.h"
+#include "textprotocol.h"
+
+//idtablecheck
+//checks the order id table's lifetime: sessions of orders, every one with ids of
+//its own, run through the table with a clear() between them, which must leave it
+//no bigger than the first session made it; and a table at its limit, which must
+//refuse new ids rather than hand out NoOrderHandle; ids restored at the handles a
+//snapshot recorded, around handles left unheld; then the same sessions as
+//messages, with an END_OF_DAY after each, through the engine one at a time, in
+//batches and pipelined, which must all report the same trades by the same names
+//and keep the engine's ids to one session's worth, and as binary records (as
+//txt2bin writes them) one at a time and in batches; exits 1 on any failure
+
+namespace
+{
+auto failures = 0;
+
+void expect(bool condition, std::string const & what)
+{
+    if (condition) return;
+    std::cout << "FAILED: " << what << std::endl;
+    ++failures;
+}
+
+std::string orderID(std::size_t session, std::size_t order)
+{
+    return "s" + std::to_string(session) + "o" + std::to_string(order);
+}
+
+void checkSessions(std::size_t sessions, std::size_t ordersPerSession)
+{//each order interned, looked up and named as the engine would over its life
+    auto table = OrderIdTable();
+    auto firstSession = std::size_t(0);
+    for (auto s = std::size_t(0); s < sessions; ++s)
+    {
+        for (auto o = std::size_t(0); o < ordersPerSession; ++o)
+        {
+            auto const id     = orderID(s, o);
+            auto const handle = table.intern(Token(id.data(), id.size()));
+            expect(handle==o, "handles start from 0 each session, " + id);
+            expect(table.find(Token(id.data(), id.size()))==handle, "find " + id);
+            expect(table.name(handle).str()==id, "name " + id);
+        }
+        if (s==0) firstSession = table.bytes();
+        expect(table.bytes() <= firstSession, "session " + std::to_string(s) + " holds " + std::to_string(table.bytes()) +
+               " bytes, more than the first session's " + std::to_string(firstSession));
+        table.clear();
+        auto const last = orderID(s, 0);
+        expect(table.size()==0 && table.find(Token(last.data(), last.size()))==NoOrderHandle, "clear forgets every id");
+    }
+    std::cout << sessions << " sessions of " << ordersPerSession << " orders: " << table.bytes() << " id bytes" << std::endl;
+}
+
+void checkLimit()
+{
+    auto table = OrderIdTable(3);
+    auto const ids = std::string("abcd");
+    for (auto i = std::size_t(0); i < 3; ++i) expect(table.intern(Token(&ids[i], 1))==i, "intern under the limit");
+    expect(table.intern(Token(&ids[3], 1))==NoOrderHandle, "a new id past the limit is refused");
+    expect(table.size()==3, "a refused id isn't held");
+    expect(table.intern(Token(&ids[1], 1))==1, "ids already held still intern past the limit");
+    table.clear();
+    expect(table.intern(Token(&ids[3], 1))==0, "clear makes room again");
+}
+
+void checkRestore()
+{//as a snapshot loads: only some ids, at their handles, and then the handle count
+    auto table = OrderIdTable();
+    auto const a = std::string("a"), b = std::string("b"), c = std::string("c");
+    expect(table.restore(5, Token(a.data(), a.size())), "restore past the end");
+    expect(table.restore(2, Token(b.data(), b.size())), "restore into a gap");
+    expect(table.restore(5, Token(a.data(), a.size())), "restore an id where it already is");
+    expect(!table.restore(2, Token(c.data(), c.size())), "a held handle isn't restored over");
+    expect(!table.restore(7, Token(b.data(), b.size())), "a held id isn't restored at another handle");
+    expect(table.advance(9) && table.size()==9, "advance to the handle count");
+    expect(!table.contains(0) && !table.contains(3) && !table.contains(8) && table.contains(2), "skipped handles aren't held");
+    expect(table.name(5).str()=="a" && table.find(Token(b.data(), b.size()))==2, "restored ids are found");
+    for (auto i = std::size_t(0); i < 5000; ++i)
+    {//enough to grow the table past its skipped handles
+        auto const id = orderID(0, i);
+        expect(table.intern(Token(id.data(), id.size()))==9 + i, "new ids follow the handle count");
+    }
+    expect(table.find(Token(a.data(), a.size()))==5 && table.find(Token(b.data(), b.size()))==2, "restored ids survive growing");
+}
+
+struct StringReportSink : ExecutionReportSink
+{//TextReportSink's lines, kept for comparing
+    void trade(TradeEvent const & trade, OrderIdTable const & orderIds) override
+    {
+        appendTrade(mOutput, trade, orderIds);
+        mOutput.append('\n');
+    }
+    void bookSide(OrderSide side) override
+    {
+        appendBookSide(mOutput, side);
+        mOutput.append('\n');
+    }
+    void bookLevel(price_t price, uint64_t quantity) override
+    {
+        appendBookLevel(mOutput, price, quantity);
+        mOutput.append('\n');
+    }
+    std::string text() const {return std::string(mOutput.data(), mOutput.size());}
+
+    StringReportSink():mOutput(){}
+    StringReportSink(StringReportSink const &)             = delete;
+    StringReportSink & operator=(StringReportSink const &) = delete;
+    ~StringReportSink(){}
+private:
+    MemoryOutput mOutput;
+};
+
+std::string sessionMessages(std::size_t sessions, std::size_t ordersPerSession)
+{//each order rests and is then filled by the next, so every trade names two ids of its session
+    auto messages = std::string();
+    for (auto s = std::size_t(0); s < sessions; ++s)
+    {
+        for (auto o = std::size_t(0); o < ordersPerSession; ++o)
+        {
+            messages += "BUY GFD 100 10 " + orderID(s, 2*o) + "\n";
+            messages += "SELL GFD 100 10 " + orderID(s, 2*o + 1) + "\n";
+        }
+        messages += "END_OF_DAY\n";
+    }
+    return messages;
+}
+
+std::string runSequential(std::string const & messages, std::size_t & maxIdBytes)
+{//one message at a time, noting the most the engine's ids ever took
+    StringReportSink sink;
+    MatchingEngine engine(sink);
+    engine.setSessionLog(nullptr);
+    MappedMessageReader reader(messages.data(), messages.size());
+    auto message = Token();
+    maxIdBytes = 0;
+    while (reader.nextMessage(message))
+    {
+        engine.processNextMessage(message);
+        maxIdBytes = std::max(maxIdBytes, engine.memory().IdBytes);
+    }
+    return sink.text();
+}
+
+std::string runBatched(std::string const & messages, std::size_t batchSize)
+{
+    StringReportSink sink;
+    MatchingEngine engine(sink);
+    engine.setSessionLog(nullptr);
+    engine.setBatchSize(batchSize);
+    MappedMessageReader reader(messages.data(), messages.size());
+    engine.processMessages(reader);
+    return sink.text();
+}
+
+std::string runPipelined(std::string const & messages)
+{
+    StringReportSink sink;
+    PipelinedEngine pipeline(sink);
+    pipeline.engine().setSessionLog(nullptr);
+    MappedMessageReader reader(messages.data(), messages.size());
+    pipeline.processMessages(reader);
+    pipeline.finish();
+    return sink.text();
+}
+
+std::FILE * binaryRecords(std::string const & messages)
+{//txt2bin's conversion, into a temporary file
+    auto const records = std::tmpfile();
+    if (!records) return nullptr;
+    auto orderIds = OrderIdTable();
+    auto tokens   = message_tokens_t();
+    MappedMessageReader reader(messages.data(), messages.size());
+    auto message = Token();
+    unsigned char record[BinaryCodec::RecordSize];
+    while (reader.nextMessage(message))
+    {
+        tokens.tokenize(message.Data, message.Size);
+        auto const command = decodeTextMessage(tokens, orderIds);
+        if (command.Type==CommandType(0)) continue;
+        BinaryCodec::encode(command, record);
+        std::fwrite(record, 1, sizeof(record), records);
+        if (command.Type==CommandType::EndOfDay) orderIds.clear();
+    }
+    return records;
+}
+
+std::string runBinary(std::FILE * records, std::size_t batchSize)
+{
+    StringReportSink sink;
+    MatchingEngine engine(sink);
+    engine.setSessionLog(nullptr);
+    engine.setBatchSize(batchSize);
+    std::rewind(records);
+    BinaryMessageReader reader(records);
+    engine.processMessages(reader);
+    return sink.text();
+}
+
+void checkEngineSessions(std::size_t sessions, std::size_t ordersPerSession)
+{
+    auto const messages = sessionMessages(sessions, ordersPerSession);
+    auto oneSession     = std::size_t(0);
+    auto allSessions    = std::size_t(0);
+    runSequential(sessionMessages(1, ordersPerSession), oneSession);
+    auto const sequential = runSequential(messages, allSessions);
+    expect(allSessions==oneSession, "the engine's ids grew to " + std::to_string(allSessions) + " bytes over " +
+           std::to_string(sessions) + " sessions, against " + std::to_string(oneSession) + " for one");
+    auto expected = std::string();
+    for (auto s = std::size_t(0); s < sessions; ++s)
+    {
+        for (auto o = std::size_t(0); o < ordersPerSession; ++o)
+        {
+            expected += "TRADE " + orderID(s, 2*o) + " 100 10 " + orderID(s, 2*o + 1) + " 100 10\n";
+        }
+    }
+    expect(sequential==expected, "trades name each session's own ids");
+    expect(runBatched(messages, 64)==sequential, "batches report what one message at a time does");
+    expect(runPipelined(messages)==sequential, "the pipeline reports what one message at a time does");
+    auto const records = binaryRecords(messages);
+    expect(records != nullptr, "a temporary file for the binary records");
+    if (!records) return;
+    auto const binary = runBinary(records, 1);
+    expect(!binary.empty() && runBinary(records, 64)==binary, "binary batches report what one record at a time does");
+    std::fclose(records);
+    std::cout << sessions << " sessions of " << 2*ordersPerSession << " orders through the engine: " << allSessions
+              << " id bytes" << std::endl;
+}
+}
+
+int main()
+{
+  checkSessions(200, 5000);
+  checkLimit();
+  checkRestore();
+  checkEngineSessions(100, 1001);
+  std::cout << (failures ? "failed" : "ok") << std::endl;
+  return failures ? 1 : 0;
+}
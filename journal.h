@@ -0,0 +1,185 @@
+#ifndef MATCHINGENGINE_JOURNAL_H
+#define MATCHINGENGINE_JOURNAL_H
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "messagereader.h"
+#include "binaryprotocol.h"
+#include "mappedfile.h"
+
+//the journal is an append-only file of the input events the engine accepted,
+//in the order it accepted them: BUY/SELL/MODIFY/CANCEL, END_OF_DAY, AUCTION and
+//UNCROSS as ordinary binary protocol records (see binaryprotocol.h), and, before
+//a new order whose id isn't already resting, a name record so replay hands out
+//the same handle for it; a replayed END_OF_DAY forgets the ids, as the engine
+//did, so the next session's name records start from handle 0 again
+//
+//  name record: a 24 byte header followed by the id, zero padded to a multiple of 8
+//  offset size field
+//       0    1 type        (JournalNameRecord)
+//       1    3 reserved    (zero)
+//       4    4 order handle
+//       8    8 reserved    (zero)
+//      16    8 id length in bytes
+//
+//PRINT and STATS change nothing, so they aren't journaled
+
+constexpr unsigned char JournalNameRecord = 0x80;
+
+struct JournalPolicy
+{
+    std::size_t RecordsPerCommit; //group commit: records buffered before one write()
+    bool        Sync;             //fdatasync after every write, for durability past an OS crash
+};
+
+inline JournalPolicy defaultJournalPolicy() {return JournalPolicy{256, false};}
+
+struct JournalWriter
+{//records are buffered and go to the file in one write per RecordsPerCommit
+    //records, or on commit(); anything still buffered when the process dies is lost,
+    //which is the price of not writing per message
+    //a commit that can't write everything keeps what it couldn't, for the next
+    //one to try again, and returns false (error() says why); append and appendName
+    //pass on the result of a commit they set off, and are otherwise true
+    bool append(Command const & command)
+    {
+        auto const offset = grow(BinaryCodec::RecordSize);
+        BinaryCodec::encode(command, mBuffer.data() + offset);
+        return recordAdded();
+    }
+    bool appendName(order_handle_t handle, Token const & orderID)
+    {
+        auto const padded = (orderID.Size + 7) & ~std::size_t(7);
+        auto const offset = grow(BinaryCodec::RecordSize + padded);
+        auto record = mBuffer.data() + offset;
+        std::memset(record, 0, BinaryCodec::RecordSize + padded);
+        record[0] = JournalNameRecord;
+        store(record +  4, handle,       4);
+        store(record + 16, orderID.Size, 8);
+        std::memcpy(record + BinaryCodec::RecordSize, orderID.Data, orderID.Size);
+        return recordAdded();
+    }
+    bool commit()
+    {
+        mPending = 0;
+        auto written = std::size_t(0);
+        mError = 0;
+        while (written < mBuffer.size())
+        {
+            auto const result = ::write(mFile, mBuffer.data() + written, mBuffer.size() - written);
+            if (result < 0 && errno==EINTR) continue;
+            if (result <= 0)
+            {
+                mError = (result < 0) ? errno : EIO;
+                break;
+            }
+            written += static_cast<std::size_t>(result);
+        }
+        mCommitted += written;
+        mBuffer.erase(mBuffer.begin(), mBuffer.begin() + static_cast<std::ptrdiff_t>(written));
+        if (mError==0 && mPolicy.Sync && written != 0 && ::fdatasync(mFile) != 0) mError = errno;
+        return mError==0;
+    }
+    bool sync()
+    {//commit, and make sure it reached the disk whatever the policy
+        if (!commit()) return false;
+        if (mFile >= 0 && !mPolicy.Sync && ::fdatasync(mFile) != 0) mError = errno;
+        return mError==0;
+    }
+    uint64_t position() const {return mCommitted + mBuffer.size();} //bytes appended so far, committed or not
+    bool     isOpen()   const {return mFile >= 0;}
+    int      error()    const {return mError;} //errno of the last commit or sync that failed, 0 if it didn't
+
+    //keepBytes of any existing journal are kept (the valid length recovery found)
+    //and the rest cut off; 0 starts a new journal
+    JournalWriter(char const * path, uint64_t keepBytes, JournalPolicy policy = defaultJournalPolicy())
+    :mFile(::open(path, O_WRONLY | O_CREAT, 0644)), mPolicy(policy), mBuffer(), mPending(0), mCommitted(keepBytes), mError(0)
+    {
+        if (mPolicy.RecordsPerCommit==0) mPolicy.RecordsPerCommit = 1;
+        if (mFile < 0) return;
+        if (::ftruncate(mFile, static_cast<off_t>(keepBytes)) != 0 ||
+            ::lseek(mFile, static_cast<off_t>(keepBytes), SEEK_SET) < 0)
+        {
+            ::close(mFile);
+            mFile = -1;
+        }
+        mBuffer.reserve(mPolicy.RecordsPerCommit*BinaryCodec::RecordSize);
+    }
+    JournalWriter(JournalWriter const &)             = delete;
+    JournalWriter & operator=(JournalWriter const &) = delete;
+    ~JournalWriter()
+    {//a failure here goes unreported; commit() first to know the tail made it
+        if (mFile < 0) return;
+        commit();
+        ::close(mFile);
+    }
+private:
+    std::size_t grow(std::size_t bytes)
+    {
+        auto const offset = mBuffer.size();
+        mBuffer.resize(offset + bytes);
+        return offset;
+    }
+    bool recordAdded() {return ++mPending < mPolicy.RecordsPerCommit || commit();}
+    static void store(unsigned char * out, uint64_t value, std::size_t width)
+    {
+        for (auto i = std::size_t(0); i < width; ++i) out[i] = static_cast<unsigned char>(value >> (8*i));
+    }
+
+    int                        mFile;
+    JournalPolicy              mPolicy;
+    std::vector<unsigned char> mBuffer;
+    std::size_t                mPending;   //records in mBuffer
+    uint64_t                   mCommitted; //bytes in the file
+    int                        mError;
+};
+
+struct JournalReader
+{//walks a mapped journal from a byte offset; stops at the end, or at a record a
+    //crash cut short, and position() then gives the length worth keeping
+    enum class Entry {End, Command, Name};
+
+    Entry next(Command & command, order_handle_t & handle, Token & orderID)
+    {
+        auto const remaining = mSize - mPosition;
+        if (remaining < BinaryCodec::RecordSize) return Entry::End;
+        auto const record = mData + mPosition;
+        if (record[0] != JournalNameRecord)
+        {
+            command    = BinaryCodec::decode(record);
+            mPosition += BinaryCodec::RecordSize;
+            return Entry::Command;
+        }
+        auto const length = load(record + 16, 8);
+        if (length > remaining - BinaryCodec::RecordSize) return Entry::End;
+        auto const padded = (static_cast<std::size_t>(length) + 7) & ~std::size_t(7);
+        if (padded > remaining - BinaryCodec::RecordSize) return Entry::End;
+        handle     = static_cast<order_handle_t>(load(record + 4, 4));
+        orderID    = Token(reinterpret_cast<char const *>(record + BinaryCodec::RecordSize), static_cast<std::size_t>(length));
+        mPosition += BinaryCodec::RecordSize + padded;
+        return Entry::Name;
+    }
+    uint64_t position() const {return mPosition;}
+
+    JournalReader(MappedFile const & journal, uint64_t offset)
+    :mData(journal.data()), mSize(journal.size()), mPosition(offset < journal.size() ? offset : journal.size()){}
+private:
+    static uint64_t load(unsigned char const * in, std::size_t width)
+    {
+        auto value = uint64_t(0);
+        for (auto i = std::size_t(0); i < width; ++i) value |= uint64_t(in[i]) << (8*i);
+        return value;
+    }
+
+    unsigned char const * mData;
+    std::size_t           mSize;
+    std::size_t           mPosition;
+};
+
+#endif
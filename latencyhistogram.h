@@ -0,0 +1,92 @@
+#ifndef MATCHINGENGINE_LATENCYHISTOGRAM_H
+#define MATCHINGENGINE_LATENCYHISTOGRAM_H
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cstdint>
+
+#include "objectsemantics.h"
+
+struct LatencyHistogram
+{//log-linear buckets: every power of two is split into 2^SubBits equal buckets,
+    //so a recorded value is off by at most 1/2^SubBits (about 3%) whatever its size,
+    //and recording is a couple of shifts and an increment; the max is kept exactly
+    static constexpr unsigned SubBits    = 5;
+    static constexpr unsigned SubBuckets = 1u << SubBits;
+
+    void record(uint64_t value)
+    {
+        ++mCounts[bucketOf(value)];
+        ++mCount;
+        if (value > mMax) mMax = value;
+    }
+    void merge(LatencyHistogram const & other)
+    {
+        for (auto i = std::size_t(0); i < mCounts.size(); ++i) mCounts[i] += other.mCounts[i];
+        mCount += other.mCount;
+        if (other.mMax > mMax) mMax = other.mMax;
+    }
+    uint64_t percentile(double percent) const
+    {//the upper edge of the bucket holding that rank, clipped to the real max
+        if (mCount==0) return 0;
+        auto rank = static_cast<uint64_t>(percent/100.0*mCount);
+        if (rank >= mCount) rank = mCount - 1;
+        auto seen = uint64_t(0);
+        for (auto i = std::size_t(0); i < mCounts.size(); ++i)
+        {
+            seen += mCounts[i];
+            if (seen > rank)
+            {
+                auto const edge = upperEdgeOf(i);
+                return (edge < mMax) ? edge : mMax;
+            }
+        }
+        return mMax;
+    }
+    uint64_t count() const {return mCount;}
+    uint64_t max()   const {return mMax;}
+
+    LatencyHistogram():mCounts((64 - SubBits + 1)*SubBuckets, 0), mCount(0), mMax(0){}
+    DEFAULT_OBJECT_SEMANTICS(LatencyHistogram)
+    ~LatencyHistogram(){}
+private:
+    static std::size_t bucketOf(uint64_t value)
+    {//values below SubBuckets get a bucket each; above that, the top SubBits+1 bits pick it
+        if (value < SubBuckets) return static_cast<std::size_t>(value);
+        auto const shift = 63u - static_cast<unsigned>(__builtin_clzll(value)) - SubBits;
+        return (shift + 1)*SubBuckets + static_cast<std::size_t>((value >> shift) - SubBuckets);
+    }
+    static uint64_t upperEdgeOf(std::size_t bucket)
+    {
+        if (bucket < SubBuckets) return bucket;
+        auto const shift = bucket/SubBuckets - 1;
+        auto const first = (uint64_t(bucket % SubBuckets) + SubBuckets) << shift;
+        return first + ((uint64_t(1) << shift) - 1);
+    }
+
+    std::vector<uint64_t> mCounts;
+    uint64_t              mCount;
+    uint64_t              mMax;
+};
+
+inline void printHistogramHeader(std::ostream & os, char const * title)
+{
+    os << std::left << std::setw(14) << title << std::right
+    << std::setw(12) << "count"
+    << std::setw(10) << "p50"
+    << std::setw(10) << "p99"
+    << std::setw(10) << "p99.9"
+    << std::setw(12) << "max" << std::endl;
+}
+inline void printHistogramRow(std::ostream & os, char const * name, LatencyHistogram const & histogram)
+{
+    os << std::left << std::setw(14) << name << std::right
+    << std::setw(12) << histogram.count()
+    << std::setw(10) << histogram.percentile(50.0)
+    << std::setw(10) << histogram.percentile(99.0)
+    << std::setw(10) << histogram.percentile(99.9)
+    << std::setw(12) << histogram.max() << std::endl;
+}
+
+#endif
@@ -1,551 +1,323 @@
 #include <iostream>
-#include <sstream>
-#include <vector>
-#include <map>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <unistd.h>
+#include <sys/stat.h>
 
-#define DEFAULT_OBJECT_SEMANTICS(TYPE)    \
-TYPE(TYPE const &)             = delete;  \
-TYPE & operator=(TYPE const &) = delete;  \
-TYPE(TYPE&&)                   = default; \
-TYPE & operator=(TYPE&&)       = default; \
+#include "matchingengine.h"
+#include "shardedengine.h"
+#include "pipeline.h"
+#include "mappedfile.h"
 
-using message_tokens_t = std::vector<std::string>;
-
-struct Order
+namespace
 {
-    std::string Side;
-    std::string TimeInForce;
-    uint64_t    Price;
-    uint64_t    Quantity;
-    std::string ID;
-    
-    //default object semantics w/ a ctor for message tokens
-    explicit Order(message_tokens_t const & messageTokens)
-    :Side        (messageTokens.at(0)),
-    TimeInForce (messageTokens.at(1)),
-    Price       (-1),
-    Quantity    (-1),
-    ID          (messageTokens.at(4))
-    {
-        std::stringstream(messageTokens.at(2)) >> Price;
-        std::stringstream(messageTokens.at(3)) >> Quantity;
-    }
-    Order():Side(), TimeInForce(), Price(-1), Quantity(-1), ID(){}
-    DEFAULT_OBJECT_SEMANTICS(Order)
-    ~Order(){}
-};
+char const * optionValue(char const * arg, char const * name)
+{//"--name=value" gives value, anything else nullptr
+    auto const length = std::strlen(name);
+    if (std::strncmp(arg, name, length) != 0 || arg[length] != '=') return nullptr;
+    return arg + length + 1;
+}
 
-struct OrderBook
-{
-    //public methods
-    //processNewBuyOrder
-    //processNewSelOrder
-    //processCancel
-    //processMod
-    //printBook
-    //ctors/assg/dtor w/ object semantics
-    
-    //processing a new order involves trying to match it against the current book
-    //and then giving it an order finder and sticking it in the book if
-    //there's anything left after the attempt to match
-    //book orders and their find information are removed if they are fully matched
-    //during the match process
-    
-    //cancelling causes no match, so we just retreive the order and throw it away
-    //modifies, b/c they can switch sides and match, are done as a cancel, but then
-    //we alter the retrieve order, and push it back into processNew...
-    
-    using price_t          = uint64_t;
-    using order_vector_t   = std::vector<Order>;
-    using order_id_t       = std::string;
-    
-    using bid_book_t       = std::map<price_t, order_vector_t, std::greater<price_t>>;
-    using ask_book_t       = std::map<price_t, order_vector_t>;
-    using order_finder_t   = Order (OrderBook::*)(price_t, order_id_t const &);
-    using order_map_t      = std::map<order_id_t, std::pair<order_finder_t, price_t>>;
-    
-    void processNewBuyOrder(Order && newOrder)
-    {
-        tryMatchOrder(newOrder, mAsks);
-        if (newOrder.TimeInForce=="GFD" && newOrder.Quantity > 0)
-        {
-            mOrderFinders[newOrder.ID] = std::make_pair(&OrderBook::bidOrderFinder, newOrder.Price);
-            mBids[newOrder.Price].push_back(std::move(newOrder));
-        }
-        //checkFullFinderConsistency(); ok
-        //checkForZeroSizeOrders(); ok
-    }
-    void processNewSelOrder(Order && newOrder)
-    {
-        tryMatchOrder(newOrder, mBids);
-        if (newOrder.TimeInForce=="GFD" && newOrder.Quantity > 0)
-        {
-            mOrderFinders[newOrder.ID] = std::make_pair(&OrderBook::askOrderFinder, newOrder.Price);
-            mAsks[newOrder.Price].push_back(std::move(newOrder));
-        }
-        //checkFullFinderConsistency(); ok
-        //checkForZeroSizeOrders(); ok
-    }
-    void processCancel(order_id_t const & orderID)
-    {//will create no matches; all we have to do is remove it
-        if (mOrderFinders.find(orderID)==mOrderFinders.end()) return; //we don't know this order
-        retrieveOrder(orderID);
-        mOrderFinders.erase(orderID);
-        //checkFullFinderConsistency(); ok
-    }
-    void processMod(message_tokens_t const & modMessageTokens)
-    {//retrieve it (which removes it), modify its info, and process as if a new order
-        auto const orderID = modMessageTokens.at(1);
-        if (mOrderFinders.find(orderID)==mOrderFinders.end()) return; //we don't know this order
-        
-        auto order = retrieveOrder(orderID);
-        mOrderFinders.erase(order.ID); //no longer there; we have moved it to here
-        
-        //alter this order for resubmission
-        order.Side = modMessageTokens.at(2);
-        std::stringstream(modMessageTokens.at(3)) >> order.Price;
-        std::stringstream(modMessageTokens.at(4)) >> order.Quantity;
-        //GFD stays the same and b/c id is the same, find info will be overwritten appropriately
-        //so we don't remove it as we did in processCancel
-        if (order.Side=="BUY") processNewBuyOrder(std::move(order));
-        else                   processNewSelOrder(std::move(order));
-    }
-    void printBook() const
-    {//both are to be descending, so the loop specification is different
-        std::cout << "SELL:" << std::endl;
-        for (auto iter = mAsks.rbegin(); iter != mAsks.rend(); ++iter)
-        {
-            printLevel(iter);
-        }
-        std::cout << "BUY:" << std::endl;
-        for (auto iter = mBids.begin(); iter != mBids.end(); ++iter)
-        {
-            printLevel(iter);
-        }
-    }
-    
-    //default object semantics
-    OrderBook():mBids(), mAsks(), mOrderFinders(){}
-    DEFAULT_OBJECT_SEMANTICS(OrderBook)
-    ~OrderBook(){}
-    
-private:
-    Order retrieveOrder(order_id_t const & orderID)
-    {
-        auto const findTools = mOrderFinders.at(orderID);
-        auto const finder    = findTools.first;
-        auto const price     = findTools.second;
-        //checkForBadFinders();
-        return (this->*finder)(price, orderID);
-    }
-    Order bidOrderFinder(price_t priceLevel, order_id_t const & orderID)
-    {
-        auto returnOrder   = Order();
-        auto & levelOrders = mBids.at(priceLevel);
-        returnOrder        = retrieveOrderInLevelOrders(levelOrders, orderID);
-        if (levelOrders.empty()) mBids.erase(priceLevel);
-        return returnOrder;
-    }
-    Order askOrderFinder(price_t priceLevel, order_id_t const & orderID)
-    {
-        auto returnOrder   = Order();
-        auto & levelOrders = mAsks.at(priceLevel);
-        returnOrder        = retrieveOrderInLevelOrders(levelOrders, orderID);
-        if (levelOrders.empty()) mAsks.erase(priceLevel);
-        return returnOrder;
-    }
-    Order retrieveOrderInLevelOrders(order_vector_t & levelOrders, order_id_t const & orderID)
-    {//we only call this when we "know it's there"
-        auto foundOrder = Order();
-        auto findIter = std::find_if(levelOrders.begin(), levelOrders.end(),
-                                     [&orderID](Order const & order)->bool
-                                     {
-                                         return (orderID==order.ID);
-                                     });
-        foundOrder = std::move(*findIter);
-        levelOrders.erase(findIter);
-        return foundOrder;
-    }
-    template <typename BookType>
-    void tryMatchOrder(Order & newOrder, BookType & bookSide)
-    {
-        auto emptyLevelsEndIter = bookSide.begin();
-        auto newOrderWillMatchBook = (newOrder.Side=="BUY") ? //side-dependent comparison
-        [](uint64_t n, uint64_t b){return (n >= b);} :
-        [](uint64_t n, uint64_t b){return (n <= b);} ;
-        for (auto iter = bookSide.begin(); iter != bookSide.end(); ++iter)
-        {
-            auto const levelPrice = iter->first;
-            if (newOrderWillMatchBook(newOrder.Price, levelPrice))
-            {
-                auto & level = iter->second;
-                matchOrder(newOrder, level);
-                if (level.empty())
-                {
-                    emptyLevelsEndIter = iter; ++emptyLevelsEndIter;
-                }
-                if (newOrder.Quantity == 0) break;
-            }
-        }
-        bookSide.erase(bookSide.begin(), emptyLevelsEndIter);
-    }
-    void matchOrder(Order & newOrder, std::vector<Order> & bookLevel)
-    {//orders are in time order at a price, and we know the prices cross
-        //so we can just have at it
-        //we'll keep an iter to one past fully matched orders, so we can remove them
-        auto lastFullyMatchedEndIter = bookLevel.begin();
-        for (auto iter = bookLevel.begin(); iter != bookLevel.end(); ++iter)
-        {
-            auto & bookOrder = *iter;
-            auto const matchSize = (bookOrder.Quantity >= newOrder.Quantity ) ?
-            (newOrder.Quantity) : (bookOrder.Quantity) ;
-            printMatch(bookOrder, newOrder, matchSize);
-            newOrder.Quantity  -= matchSize;
-            bookOrder.Quantity -= matchSize;
-            if (bookOrder.Quantity==0)//we want to remove totally matched orders
-            {//I don't like splitting the removal, but we're trying to be quick
-                mOrderFinders.erase(bookOrder.ID); //remove from finder book
-                lastFullyMatchedEndIter = iter; ++lastFullyMatchedEndIter;
-            }
-            if (newOrder.Quantity == 0) break;
-        }
-        //now erase from book level vector
-        bookLevel.erase(bookLevel.begin(), lastFullyMatchedEndIter);
-    }
-    void printMatch(Order const & bookOrder, Order const & newOrder, uint64_t const matchSize) const
-    {
-        std::cout << "TRADE " << bookOrder.ID << " " //we know book order came first
-        << bookOrder.Price << " "
-        << matchSize      << " "
-        << newOrder.ID    << " "
-        << newOrder.Price << " "
-        << matchSize      << std::endl;
-    }
-    template <typename MapIter>
-    void printLevel(MapIter const & iter) const
-    {
-        auto const & priceLevel = iter->second;
-        auto totalQuantity = 0;
-        for (auto const & o : priceLevel) totalQuantity += o.Quantity;
-        std::cout << iter->first << " " << totalQuantity << std::endl;
-    }
-    
-    //debugging methods
-    void checkForCrossedBook() const
-    {
-        if (mBids.empty() || mAsks.empty()) return;
-        auto const bestBid = mBids.begin()->first;
-        auto const bestAsk = mAsks.begin()->first;
-        if (bestAsk <= bestBid) throw;
-    }
-    void checkForFindersConsistency() const
-    {
-        for (auto const & kv : mOrderFinders)
-        {
-            auto const orderID = kv.first;
-            auto const price   = kv.second.second;
-            auto const finder  = [&orderID](Order const & o){return o.ID==orderID;};
-            auto priceFound = false;
-            if (mBids.find(price) != mBids.end())
-            {
-                priceFound = true;
-                auto const & level = mBids.at(price);
-                if (find_if(level.begin(), level.end(), finder)==level.end()) throw;
-            }
-            if (mAsks.find(price) != mAsks.end())
-            {
-                priceFound = true;
-                auto const & level = mAsks.at(price);
-                if (find_if(level.begin(), level.end(), finder)==level.end()) throw;
-            }
-            //if (!priceFound) throw; this goes beyond consistency; narrowed to this, so checkForBadFinders
-        }
-    }
-    void checkForBadFinders() const
-    {
-        auto throwIfOrderNotElsewhere = false;
-        for (auto const & kv : mOrderFinders)
-        {
-            auto const finderPrice = kv.second.second;
-            auto const bidFindIter = mBids.find(finderPrice);
-            auto const askFindIter = mAsks.find(finderPrice);
-            if (bidFindIter==mBids.end() && askFindIter==mAsks.end()) throwIfOrderNotElsewhere = true;
-            if (throwIfOrderNotElsewhere)
-            {//ok, good; they should just simply not be here, as finders
-                //for (auto const & pl : mBids)
-                //  for (auto const & o : pl.second) if (o.ID == kv.first) throwIfOrderNotElsewhere = false;
-                //for (auto const & pl : mAsks)
-                //  for (auto const & o : pl.second) if (o.ID == kv.first) throwIfOrderNotElsewhere = false;
-                break;
-            }
-        }
-        if (throwIfOrderNotElsewhere) throw;
-    }
-    void checkFullFinderConsistency() const
-    {
-        //every order has a finder and it's got the right location
-        auto foundIDs = std::vector<std::string>();
-        checkBookAndAddIds(mBids, foundIDs);
-        checkBookAndAddIds(mAsks, foundIDs);
-        //and that's all the finders there are
-        for (auto const id : foundIDs)
-            if (mOrderFinders.find(id)==mOrderFinders.end()) throw;
-    }
-    template <typename BookType>
-    void checkBookAndAddIds(BookType const & bookSide, std::vector<std::string> & foundIDs) const
-    {
-        for (auto const & kv : bookSide)
-        {
-            auto const price   = kv.first;
-            auto const & level = kv.second;
-            for (auto const & o : level)
-            {
-                auto findIter = mOrderFinders.find(o.ID);
-                if (findIter == mOrderFinders.end()) throw;
-                if (findIter->second.second != price) throw;
-                foundIDs.push_back(o.ID);
-            }
-        }
-    }
-    void checkForZeroSizeOrders() const
-    {
-        checkForZeroSize(mBids);
-        checkForZeroSize(mAsks);
-    }
-    template <typename BookType>
-    void checkForZeroSize(BookType const & bookSide) const
+bool parseBand(char const * value, PriceBand & band)
+{//"LOW:TICKS"
+    auto end = static_cast<char *>(nullptr);
+    band.Low = std::strtoull(value, &end, 10);
+    if (end==value || *end != ':') return false;
+    value      = end + 1;
+    band.Ticks = std::strtoull(value, &end, 10);
+    return end != value && *end=='\0' && band.Ticks != 0;
+}
+
+bool holdsData(char const * path)
+{//exists and isn't empty
+    struct stat status;
+    return path && ::stat(path, &status)==0 && status.st_size > 0;
+}
+
+template <typename Engine>
+uint64_t readText(Engine & engine, std::FILE * input, MappedFile const * mapped)
+{//straight from the mapping when there is one, returning how many messages it held;
+    //through MessageReader's buffer otherwise
+    if (mapped)
     {
-        for (auto const & kv : bookSide) for (auto const & o : kv.second) if (o.Quantity==0) throw;
+        MappedMessageReader reader(reinterpret_cast<char const *>(mapped->data()), mapped->size());
+        engine.processMessages(reader);
+        return reader.messages();
     }
-    
-private:
-    bid_book_t  mBids;
-    ask_book_t  mAsks;
-    order_map_t mOrderFinders;
-};
-
+    MessageReader reader(input);
+    engine.processMessages(reader);
+    return 0;
+}
 
-struct MatchingEngine
+void printReplay(uint64_t messages, std::size_t bytes, std::chrono::steady_clock::time_point start)
 {
-    void processNextMessage(std::string const & message)
+    auto const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << "replayed " << messages << " messages, " << bytes/1e6 << " MB in " << seconds << " s: "
+    << static_cast<uint64_t>(messages/seconds) << " msgs/s, " << bytes/1e6/seconds << " MB/s" << std::endl;
+}
+}
+
+int main(int argc, char ** argv)
+{//matchingengine [--binary] [--stats] [--reports=text|binary|null]
+  //               [--l2=FILE [--l2-format=text|binary] [--l2-batch=N]]
+  //               [--journal=FILE [--group-commit=N] [--sync] [--snapshot=FILE [--snapshot-every=N]] [--recover|--fresh]]
+  //               [--symbols [--workers=N] [--pin]] [--pipeline] [--mmap] [--batch=N] [--band=LOW:TICKS]
+  //               [file]
+  //reads messages from the named file, or stdin if there is none; --binary expects
+  //fixed-width records (see binaryprotocol.h, and txt2bin to produce them);
+  //--stats reports the book's memory on stderr at the end (see MemoryReport); trades and
+  //printed books go to stdout as text (flushed per message on a terminal, when the
+  //buffer fills otherwise), as binary report records (see reportsink.h), or nowhere;
+  //--l2 also writes L2 level deltas to FILE, published every N messages (see marketdata.h);
+  //--journal appends every accepted event to FILE, snapshotting the book every N events;
+  //--recover first rebuilds the book from the snapshot and journal and carries on
+  //appending, and --fresh discards both and starts again; with neither, a journal or
+  //snapshot that already holds anything stops the engine rather than being thrown
+  //away (see journal.h and snapshot.h);
+  //--symbols expects every line to lead with a symbol, and runs each symbol's book
+  //on one of N worker threads (see shardedengine.h); reports are text or null there;
+  //--pipeline parses, matches and writes reports on three threads (see pipeline.h);
+  //--mmap replays a text file straight from its mapped pages, and reports the
+  //replay's messages/sec and MB/sec on stderr; --batch decodes N messages at a time
+  //and runs them as one batch, with lookahead and one report flush (see processBatch);
+  //--band puts every book's ladder (make BOOK=ladder) over TICKS prices from LOW, in
+  //place of defaultPriceBand(), or with --symbols, defaultShardConfig()'s narrow one
+  auto binary        = false;
+  auto stats         = false;
+  auto reports       = "text";
+  auto l2Name        = static_cast<char const *>(nullptr);
+  auto l2Format      = "text";
+  auto l2Batch       = std::size_t(1);
+  auto journalName   = static_cast<char const *>(nullptr);
+  auto snapshotName  = static_cast<char const *>(nullptr);
+  auto snapshotEvery = std::size_t(1000000);
+  auto journalPolicy = defaultJournalPolicy();
+  auto recover       = false;
+  auto fresh         = false;
+  auto symbols       = false;
+  auto pipelined     = false;
+  auto mapInput      = false;
+  auto batchSize     = std::size_t(1);
+  auto shards        = defaultShardConfig();
+  auto band          = defaultPriceBand();
+  auto bandGiven     = false;
+  auto inputName     = static_cast<char const *>(nullptr);
+  for (auto i = 1; i < argc; ++i)
+  {
+    auto const arg = argv[i];
+    auto value     = static_cast<char const *>(nullptr);
+    if      (std::strcmp(arg, "--binary")==0)                  binary        = true;
+    else if (std::strcmp(arg, "--stats")==0)                   stats         = true;
+    else if (std::strcmp(arg, "--sync")==0)                    journalPolicy.Sync = true;
+    else if (std::strcmp(arg, "--recover")==0)                 recover       = true;
+    else if (std::strcmp(arg, "--fresh")==0)                   fresh         = true;
+    else if (std::strcmp(arg, "--symbols")==0)                 symbols       = true;
+    else if (std::strcmp(arg, "--pin")==0)                     shards.Pin    = true;
+    else if (std::strcmp(arg, "--pipeline")==0)                pipelined     = true;
+    else if (std::strcmp(arg, "--mmap")==0)                    mapInput      = true;
+    else if ((value = optionValue(arg, "--reports")))          reports       = value;
+    else if ((value = optionValue(arg, "--l2")))               l2Name        = value;
+    else if ((value = optionValue(arg, "--l2-format")))        l2Format      = value;
+    else if ((value = optionValue(arg, "--l2-batch")))         l2Batch       = std::strtoull(value, nullptr, 10);
+    else if ((value = optionValue(arg, "--journal")))          journalName   = value;
+    else if ((value = optionValue(arg, "--snapshot")))         snapshotName  = value;
+    else if ((value = optionValue(arg, "--snapshot-every")))   snapshotEvery = std::strtoull(value, nullptr, 10);
+    else if ((value = optionValue(arg, "--group-commit")))     journalPolicy.RecordsPerCommit = std::strtoull(value, nullptr, 10);
+    else if ((value = optionValue(arg, "--workers")))          shards.Workers = std::strtoull(value, nullptr, 10);
+    else if ((value = optionValue(arg, "--batch")))            batchSize     = std::strtoull(value, nullptr, 10);
+    else if ((value = optionValue(arg, "--band")))
     {
-        dispatchMessage(tokenizeMessage(message));
+      bandGiven = parseBand(value, band);
+      if (!bandGiven)
+      {
+        std::cerr << "--band takes LOW:TICKS, with TICKS at least 1" << std::endl;
+        return 1;
+      }
     }
-    
-    MatchingEngine():mOrderBook(){}
-    DEFAULT_OBJECT_SEMANTICS(MatchingEngine)
-    ~MatchingEngine(){}
-private:
-    void dispatchMessage(std::vector<std::string> const & messageTokens)
+    else                                                       inputName     = arg;
+  }
+  if (bandGiven) shards.Band = band;
+
+  auto input  = stdin;
+  auto mapped = std::unique_ptr<MappedFile>();
+  if (mapInput)
+  {
+    if (!inputName || binary)
     {
-        if (messageTokens.front()=="PRINT")
-            printBook();
-        else
-            processOrderMessage(messageTokens);
+      std::cerr << "--mmap replays a named text file" << std::endl;
+      return 1;
     }
-    void printBook(){mOrderBook.printBook();}
-    void processOrderMessage(message_tokens_t const & messageTokens)
+    mapped.reset(new MappedFile(inputName));
+    if (!mapped->isOpen())
     {
-        auto const & leadToken = messageTokens.front();
-        if      (leadToken=="BUY")    mOrderBook.processNewBuyOrder(Order(messageTokens));
-        else if (leadToken=="SELL")   mOrderBook.processNewSelOrder(Order(messageTokens));
-        else if (leadToken=="MODIFY") mOrderBook.processMod(messageTokens);
-        else if (leadToken=="CANCEL") mOrderBook.processCancel(messageTokens.at(1));
-        else ; //throw runtime_error?
+      std::cerr << "could not open " << inputName << std::endl;
+      return 1;
     }
-    message_tokens_t tokenizeMessage(std::string const & message)
+    mapped->adviseSequential();
+  }
+  else if (inputName)
+  {
+    input = std::fopen(inputName, "rb");
+    if (!input)
     {
-        auto tokens           = message_tokens_t();
-        auto tokenStart       = 0;
-        auto const messageEnd = message.size();
-        for (auto i = 0; i < messageEnd; ++i)
-        {
-            if (message[i]==' ')
-            {
-                tokens.push_back(message.substr(tokenStart, i - tokenStart));
-                tokenStart = i + 1;
-            }
-        } 
-        tokens.push_back(message.substr(tokenStart, messageEnd - tokenStart));
-        return tokens;
+      std::cerr << "could not open " << inputName << std::endl;
+      return 1;
     }
-private:
-    OrderBook mOrderBook;
-};//end MatchingEngine
-
-#undef DEFAULT_OBJECT_SEMANTICS
-
-
-int main()
-{
-  auto messages = std::vector<std::string>();
-  messages.push_back("BUY GFD 11 100 order1");
-  messages.push_back("BUY GFD 10 200 order2");
-  messages.push_back("MODIFY order2 SELL 10 1000");
-  messages.push_back("PRINT");
-
-
-  for (auto const & m : messages) std::cout << m << std::endl; 
-  std::cout << std::endl << std::endl;
+  }
 
-  auto engine = MatchingEngine();
-  for (auto const & message : messages)
+  if (!journalName && (recover || fresh || snapshotName))
   {
-    engine.processNextMessage(message);
+    std::cerr << "--recover, --fresh and --snapshot go with --journal" << std::endl;
+    return 1;
   }
-
-  std::cout << "matching engine exiting" << std::endl;
-  return 0;
-}
-
-
-/*struct OrderBook
-{
-  void addBuy(Order && newOrder)
-  {//iterate over the ask levels; we assume > 0 on newOrder
-    auto fullyMatchedLevelsEndIter = mAsks.begin();
-    for (auto iter = mAsks.begin(); iter != mAsks.end(); ++iter)
-    {//if we cross the book, match against that level
-      auto const bookLevelPrice = iter->first;
-      if      (newOrder.Price >= bookLevelPrice)
-      {
-        matchOrders(iter->second, newOrder);//can alter both arguments
-        if ((iter->second).empty())
-        {//map iter doesn't seem to support " = iter + 1 "
-          fullyMatchedLevelsEndIter = iter; ++fullyMatchedLevelsEndIter;
-        }
-        if (newOrder.Quantity==0) break; //if we fully matched, we're done 
-      }
-    }
-    mAsks.erase(mAsks.begin(), fullyMatchedLevelsEndIter);
-    if (newOrder.Quantity != 0 && newOrder.TimeInForce=="GFD")
+  if (recover && fresh)
+  {
+    std::cerr << "--recover carries on from the journal and --fresh discards it; pick one" << std::endl;
+    return 1;
+  }
+  if (journalName && !recover && !fresh && (holdsData(journalName) || holdsData(snapshotName)))
+  {//starting afresh would truncate the journal and remove the snapshot, the only record of the last run
+    std::cerr << (holdsData(journalName) ? journalName : snapshotName)
+    << " already holds a previous run; --recover to carry on from it, or --fresh to discard it" << std::endl;
+    return 1;
+  }
+  if (pipelined && (symbols || journalName))
+  {
+    std::cerr << "--pipeline runs one book, without --symbols or --journal" << std::endl;
+    return 1;
+  }
+  if (batchSize != 1 && (pipelined || symbols))
+  {
+    std::cerr << "--batch is for the sequential engine; --pipeline and --symbols hand messages on one by one" << std::endl;
+    return 1;
+  }
+  if (symbols)
+  {
+    if (binary || l2Name || journalName || (std::strcmp(reports, "text") != 0 && std::strcmp(reports, "null") != 0))
     {
-      mBids[newOrder.Price].push_back(std::move(newOrder));
+      std::cerr << "--symbols takes text messages and text or null reports, without --l2 or --journal" << std::endl;
+      return 1;
     }
-  }
-  void addSel(Order && newOrder)
-  {//see comments under addBuy; should unify this code if possible
-    auto fullyMatchedLevelsEndIter = mBids.begin();
-    for (auto iter = mBids.begin(); iter != mBids.end(); ++iter)
     {
-      auto const bookLevelPrice = iter->first;
-      if (newOrder.Price <= bookLevelPrice)
+      auto const text = std::strcmp(reports, "text")==0;
+      ShardedEngine engine(shards, text ? stdout : nullptr,
+                           isatty(fileno(stdout)) ? FlushPolicy::EveryMessage : FlushPolicy::WhenFull);
+      auto const start    = std::chrono::steady_clock::now();
+      auto const messages = readText(engine, input, mapped.get());
+      engine.finish();
+      if (mapped) printReplay(messages, mapped->size(), start);
+      if (stats)
       {
-        matchOrders(iter->second, newOrder);
-        if ((iter->second).empty())
-        {
-          fullyMatchedLevelsEndIter = iter; ++fullyMatchedLevelsEndIter;
-        }
-        if (newOrder.Quantity==0) break;
+        std::cerr << "symbols: " << engine.symbols() << ", messages per worker:";
+        for (auto w = std::size_t(0); w < engine.workers(); ++w) std::cerr << ' ' << engine.workerMessages(w);
+        std::cerr << std::endl;
       }
     }
-    mBids.erase(mBids.begin(), fullyMatchedLevelsEndIter);
-    if (newOrder.Quantity != 0 && newOrder.TimeInForce=="GFD")
-    {
-      mAsks[newOrder.Price].push_back(std::move(newOrder));
-    }
-  }
-  void doMod(std::vector<std::string> const & messageTokens)
-  {
-    auto const & orderID = messageTokens.at(1);
-    auto newTokens = messageTokens;
-    newTokens.at(0) = newTokens.at(2);
-    newTokens.at(1) = "GFD";
-    newTokens.erase(newTokens.begin() + 2);
-    newTokens.push_back(orderID); //now we have tokens for a new order
-    doCancel(orderID);
-    if (newTokens.at(0)=="BUY") addBuy(Order(newTokens));
-    else                        addSel(Order(newTokens));
+    if (input != stdin) std::fclose(input);
+    return 0;
   }
-  void doCancel(std::vector<std::string> const & messageTokens)
+
+  auto sink = std::unique_ptr<ExecutionReportSink>();
+  if      (std::strcmp(reports, "text")==0)
+    sink.reset(new TextReportSink(stdout, isatty(fileno(stdout)) ? FlushPolicy::EveryMessage : FlushPolicy::WhenFull));
+  else if (std::strcmp(reports, "binary")==0) sink.reset(new BinaryReportSink(stdout));
+  else if (std::strcmp(reports, "null")==0)   sink.reset(new NullReportSink());
+  else
   {
-    auto const & orderIDToCancel = messageTokens.at(1);
-    doCancel(orderIDToCancel);
+    std::cerr << "unknown report format " << reports << std::endl;
+    return 1;
   }
-  void doCancel(std::string const & orderIDToCancel)
+
+  auto l2File     = static_cast<std::FILE *>(nullptr);
+  auto marketData = std::unique_ptr<MarketDataSink>();
+  if (l2Name)
   {
-    auto bidIter = findAndRemoveOrder(mBids, orderIDToCancel);
-    if (bidIter != mBids.end())
+    l2File = std::fopen(l2Name, "wb");
+    if (!l2File)
     {
-      if ((bidIter->second).empty()) mBids.erase(bidIter);
-      return;
-    } 
-    auto askIter = findAndRemoveOrder(mAsks, orderIDToCancel);
-    if (askIter != mAsks.end())
+      std::cerr << "could not open " << l2Name << std::endl;
+      return 1;
+    }
+    if      (std::strcmp(l2Format, "text")==0)   marketData.reset(new TextMarketDataSink(l2File));
+    else if (std::strcmp(l2Format, "binary")==0) marketData.reset(new BinaryMarketDataSink(l2File));
+    else
     {
-      if ((askIter->second).empty()) mAsks.erase(askIter);
-      return;
+      std::cerr << "unknown l2 format " << l2Format << std::endl;
+      return 1;
     }
-    else std::cout << "could not find order:  " << orderIDToCancel << std::endl;
   }
-  template <typename MapType>
-  typename MapType::iterator findAndRemoveOrder(MapType & map, std::string const & orderID)
+
+  //pipelined, the engine runs on the pipeline's matcher thread, and is only set up
+  //before messages start and read after they finish
+  auto pipelineConfig = defaultPipelineConfig();
+  pipelineConfig.Band = band;
+  if (!mapped && isatty(fileno(input))) pipelineConfig.Batch = 1;
+  auto pipeline   = std::unique_ptr<PipelinedEngine>(pipelined ? new PipelinedEngine(*sink, pipelineConfig) : nullptr);
+  auto sequential = std::unique_ptr<MatchingEngine>(pipelined ? nullptr : new MatchingEngine(*sink, band));
+  auto & engine   = pipeline ? pipeline->engine() : *sequential;
+  auto journal = std::unique_ptr<JournalWriter>();
+  if (journalName)
   {
-    for (auto iter = map.begin(); iter != map.end(); ++iter)
+    auto keepBytes = uint64_t(0);
+    if (recover)
     {
-      auto & level = iter->second;
-      auto findIter = find_if(level.begin(), level.end(), 
-      [&orderID](Order const & order)
-      {
-        return (order.ID == orderID);
-      });
-      if (findIter != level.end())
-      {
-        level.erase(findIter);
-        return iter;
+      auto const recovered = engine.recover(snapshotName, journalName);
+      keepBytes = recovered.JournalBytes;
+      std::cerr << "recovered: snapshot " << (recovered.SnapshotLoaded ? "loaded" : "none")
+      << " (" << recovered.SnapshotOrders << " orders), " << recovered.JournalEvents << " journal events replayed, "
+      << engine.orderPoolStats().Live << " orders resting" << std::endl;
+      if (recovered.JournalRejected)
+      {//carrying on would also cut the journal off at the bad record
+        std::cerr << journalName << " names an id at a handle that disagrees with the snapshot or itself; not recovering" << std::endl;
+        return 1;
       }
-    } 
-    return map.end();
-  }  
-
-  void matchOrders(std::vector<Order> & bookLevel, Order & newOrder)
-  {//orders are in time order at a price, and we know the prices cross
-   //so we can just have at it; notice we don't have to care about
-   //who's the buy and who's the sell here
-   //we'll keep an iter to one past fully matched orders, so we can remove them
-    auto lastFullyMatchedEndIter = bookLevel.begin();
-    for (auto iter = bookLevel.begin(); iter != bookLevel.end(); ++iter)
-    {
-      auto & bookOrder = *iter;
-      std::cout << "TRADE " << bookOrder.ID << " " //we know book o came first
-                << bookOrder.Quantity << " "
-                << bookOrder.Price    << " "     
-                << newOrder.ID        << " "
-                << newOrder.Quantity  << " "
-                << newOrder.Price     << std::endl;
-      auto const matchSize = (bookOrder.Quantity >= newOrder.Quantity ) ?
-                             (newOrder.Quantity) : (bookOrder.Quantity) ;
-      newOrder.Quantity  -= matchSize;
-      bookOrder.Quantity -= matchSize;
-      if (bookOrder.Quantity==0)
-      {
-        lastFullyMatchedEndIter = iter; ++lastFullyMatchedEndIter;
-      } 
-      if (newOrder.Quantity == 0) break;
     }
-    bookLevel.erase(bookLevel.begin(), lastFullyMatchedEndIter);   
-   }
-  void printBook() const
-  {//both sides are requested in decreasing order
-    std::cout << "SELL:" << std::endl;
-    for (auto iter = mAsks.rbegin(); iter != mAsks.rend(); ++iter)
+    else if (snapshotName) std::remove(snapshotName); //it would describe a journal that no longer exists
+    journal.reset(new JournalWriter(journalName, keepBytes, journalPolicy));
+    if (!journal->isOpen())
     {
-      auto const & priceLevel = iter->second;
-      auto totalQuantity = 0;
-      for (auto const & o : priceLevel) totalQuantity += o.Quantity;
-      std::cout << iter->first << " " << totalQuantity << std::endl;
+      std::cerr << "could not open " << journalName << std::endl;
+      return 1;
     }
-    std::cout << "BUY:" << std::endl;
-    for (auto iter = mBids.begin(); iter != mBids.end(); ++iter)
+    engine.setJournal(journal.get(), snapshotName, snapshotEvery);
+    if (recover) engine.takeSnapshot(); //so the next recovery starts from here
+  }
+  if (marketData) engine.setMarketDataSink(marketData.get(), l2Batch);
+  engine.setBatchSize(batchSize);
+  auto const start    = std::chrono::steady_clock::now();
+  auto       messages = uint64_t(0);
+  if (binary)
+  {
+    BinaryMessageReader reader(input);
+    if (pipeline) pipeline->processMessages(reader);
+    else          engine.processMessages(reader);
+  }
+  else if (pipeline) messages = readText(*pipeline, input, mapped.get());
+  else              messages = readText(engine, input, mapped.get());
+  if (pipeline) pipeline->finish();
+
+  sink->flush();
+  if (mapped) printReplay(messages, mapped->size(), start);
+  if (marketData)
+  {
+    engine.publishMarketData();
+    marketData.reset();
+    std::fclose(l2File);
+  }
+  if (journal)
+  {
+    engine.setJournal(nullptr);
+    if (!journal->commit())
     {
-      auto const & priceLevel = iter->second;
-      auto totalQuantity = 0;
-      for (auto const & o : priceLevel) totalQuantity += o.Quantity;
-      std::cout << iter->first << " " << totalQuantity << std::endl;
+      std::cerr << "journal write failed: " << std::strerror(journal->error()) << "; its tail is lost" << std::endl;
+      return 1;
     }
+    journal.reset();
   }
-private:
-  std::map<uint64_t, std::vector<Order>, std::greater<uint64_t>> mBids;
-  std::map<uint64_t, std::vector<Order>>                         mAsks;
-};//end OrderBook
-*/
+  if (stats) std::cerr << engine.memory() << std::endl;
+  if (input != stdin) std::fclose(input);
+  return 0;
+}
@@ -0,0 +1,55 @@
+#ifndef MATCHINGENGINE_MAPPEDFILE_H
+#define MATCHINGENGINE_MAPPEDFILE_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct MappedFile
+{//a whole file mapped read-only; an empty or missing file maps as no bytes at all,
+    //which callers can't tell from an empty one unless they ask isOpen()
+    unsigned char const * data()   const {return mData;}
+    std::size_t           size()   const {return mSize;}
+    bool                  isOpen() const {return mOpened;}
+    void adviseSequential() const
+    {//for one pass front to back: read ahead hard, and drop pages once past them
+        if (!mData) return;
+        ::madvise(const_cast<unsigned char *>(mData), mSize, MADV_SEQUENTIAL);
+        ::madvise(const_cast<unsigned char *>(mData), mSize, MADV_WILLNEED);
+    }
+
+    explicit MappedFile(char const * path)
+    :mData(nullptr), mSize(0), mOpened(false)
+    {
+        auto const fd = ::open(path, O_RDONLY);
+        if (fd < 0) return;
+        mOpened = true;
+        struct stat info;
+        if (::fstat(fd, &info)==0 && info.st_size > 0)
+        {
+            auto const mapped = ::mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED)
+            {
+                mData = static_cast<unsigned char const *>(mapped);
+                mSize = static_cast<std::size_t>(info.st_size);
+            }
+        }
+        ::close(fd); //the mapping keeps its own reference
+    }
+    MappedFile(MappedFile const &)             = delete;
+    MappedFile & operator=(MappedFile const &) = delete;
+    ~MappedFile()
+    {
+        if (mData) ::munmap(const_cast<unsigned char *>(mData), mSize);
+    }
+private:
+    unsigned char const * mData;
+    std::size_t           mSize;
+    bool                  mOpened;
+};
+
+#endif
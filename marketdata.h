@@ -0,0 +1,203 @@
+#ifndef MATCHINGENGINE_MARKETDATA_H
+#define MATCHINGENGINE_MARKETDATA_H
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "objectsemantics.h"
+#include "ordertypes.h"
+#include "reportsink.h"
+
+//incremental L2 market data: the book notes every level it is about to change,
+//and on publish each distinct level touched since the last publish is compared
+//with its state at first touch; only real changes go out, as sequence-numbered
+//L2Updates, so publishing costs O(touched levels) whatever the size of the book;
+//a book emptied at once (END_OF_DAY) goes out as one Clear per side rather than
+//a Delete per level
+
+enum class L2Action : uint8_t {New = 1, Change = 2, Delete = 3, Clear = 4};
+
+struct L2Update
+{//Quantity and Orders are the level's totals after the change; both zero for Delete,
+    //and for Clear, which drops every level on Side and has no Price either
+    uint64_t  Sequence;
+    OrderSide Side;
+    L2Action  Action;
+    price_t   Price;
+    uint64_t  Quantity;
+    uint64_t  Orders;
+};
+
+struct MarketDataSink
+{//updates from one publish arrive in side then price order, after the Clears if
+    //the book was emptied since the last one, then one endOfUpdates
+    virtual void levelUpdate(L2Update const & update) = 0;
+    virtual void endOfUpdates(uint64_t lastSequence) = 0;
+    virtual void flush() {}
+    virtual ~MarketDataSink(){}
+};
+
+struct LevelChangeTracker
+{
+    template <typename Level>
+    void touch(OrderSide side, price_t price, Level const & level)
+    {//call before changing the level; a level that doesn't exist yet is empty
+        mTouched.push_back(Touched{price, level.quantity(), level.size(), side, mTouched.size()});
+    }
+    void clear()
+    {//every level has gone; the touches so far are dropped with them, and the next
+        //publish starts with a Clear for each side
+        mTouched.clear();
+        mCleared = true;
+    }
+    template <typename FindLevel>
+    void publish(MarketDataSink & sink, FindLevel && findLevel)
+    {//findLevel(side, price) gives the level now, or nullptr if it has gone
+        if (mTouched.empty() && !mCleared) return;
+        auto const firstSequence = mSequence;
+        if (mCleared)
+        {
+            sink.levelUpdate(L2Update{++mSequence, OrderSide::Buy,  L2Action::Clear, 0, 0, 0});
+            sink.levelUpdate(L2Update{++mSequence, OrderSide::Sell, L2Action::Clear, 0, 0, 0});
+            mCleared = false;
+        }
+        std::sort(mTouched.begin(), mTouched.end(), [](Touched const & a, Touched const & b)
+        {
+            if (a.Side != b.Side)   return a.Side < b.Side;
+            if (a.Price != b.Price) return a.Price < b.Price;
+            return a.Ordinal < b.Ordinal; //the first touch holds the state before the batch
+        });
+        for (auto i = std::size_t(0); i < mTouched.size(); ++i)
+        {
+            auto const & before = mTouched[i];
+            if (i != 0 && mTouched[i - 1].Side==before.Side && mTouched[i - 1].Price==before.Price) continue;
+            auto const level    = findLevel(before.Side, before.Price);
+            auto const quantity = level ? level->quantity() : uint64_t(0);
+            auto const orders   = level ? level->size()     : uint64_t(0);
+            if (quantity==before.Quantity && orders==before.Orders) continue; //touched, but back where it was
+            auto const action = (before.Orders==0) ? L2Action::New : (orders==0) ? L2Action::Delete : L2Action::Change;
+            sink.levelUpdate(L2Update{++mSequence, before.Side, action, before.Price, quantity, orders});
+        }
+        if (mSequence != firstSequence) sink.endOfUpdates(mSequence);
+        mTouched.clear();
+    }
+    uint64_t sequence() const {return mSequence;}
+
+    LevelChangeTracker():mTouched(), mSequence(0), mCleared(false){}
+    DEFAULT_OBJECT_SEMANTICS(LevelChangeTracker)
+    ~LevelChangeTracker(){}
+private:
+    struct Touched
+    {
+        price_t     Price;
+        uint64_t    Quantity;
+        uint64_t    Orders;
+        OrderSide   Side;
+        std::size_t Ordinal;
+    };
+
+    std::vector<Touched> mTouched; //kept between publishes, so it stops allocating once warm
+    uint64_t             mSequence;
+    bool                 mCleared;  //since the last publish
+};
+
+struct TextMarketDataSink : MarketDataSink
+{//one line per update: L2 sequence side action price quantity orders
+    void levelUpdate(L2Update const & update) override
+    {
+        static char const * const actions[] = {"", " NEW ", " CHANGE ", " DELETE ", " CLEAR "};
+        mOutput.append("L2 ", 3);
+        mOutput.appendUnsigned(update.Sequence);
+        if (update.Side==OrderSide::Buy) mOutput.append(" BUY", 4);
+        else                             mOutput.append(" SELL", 5);
+        auto const action = actions[static_cast<std::size_t>(update.Action)];
+        mOutput.append(action, std::strlen(action));
+        mOutput.appendUnsigned(update.Price);
+        mOutput.append(' ');
+        mOutput.appendUnsigned(update.Quantity);
+        mOutput.append(' ');
+        mOutput.appendUnsigned(update.Orders);
+        mOutput.append('\n');
+        if (mPolicy==FlushPolicy::EveryEvent) mOutput.flush();
+    }
+    void endOfUpdates(uint64_t) override {if (mPolicy==FlushPolicy::EveryMessage) mOutput.flush();}
+    void flush()                override {mOutput.flush();}
+
+    explicit TextMarketDataSink(std::FILE * output, FlushPolicy policy = FlushPolicy::WhenFull)
+    :mOutput(output), mPolicy(policy){}
+    TextMarketDataSink(TextMarketDataSink const &)             = delete;
+    TextMarketDataSink & operator=(TextMarketDataSink const &) = delete;
+    ~TextMarketDataSink(){mOutput.flush();}
+private:
+    OutputBuffer mOutput;
+    FlushPolicy  mPolicy;
+};
+
+//binary L2 records, little-endian like the other binary formats
+//
+//  offset size field
+//       0    1 type          (1 level update, 2 end of updates)
+//       1    1 side          (OrderSide; level update)
+//       2    1 action        (L2Action; level update)
+//       3    5 reserved      (zero)
+//       8    8 sequence      (end of updates: the last one published)
+//      16    8 price         (level update; zero for a clear)
+//      24    8 quantity      (level update)
+//      32    8 orders        (level update)
+
+struct L2Codec
+{
+    static constexpr std::size_t RecordSize = 40;
+
+    static void encodeUpdate(L2Update const & update, unsigned char * record)
+    {
+        std::memset(record, 0, RecordSize);
+        record[0] = 1;
+        record[1] = static_cast<unsigned char>(update.Side);
+        record[2] = static_cast<unsigned char>(update.Action);
+        store(record +  8, update.Sequence, 8);
+        store(record + 16, update.Price,    8);
+        store(record + 24, update.Quantity, 8);
+        store(record + 32, update.Orders,   8);
+    }
+    static void encodeEnd(uint64_t lastSequence, unsigned char * record)
+    {
+        std::memset(record, 0, RecordSize);
+        record[0] = 2;
+        store(record + 8, lastSequence, 8);
+    }
+private:
+    static void store(unsigned char * out, uint64_t value, std::size_t width)
+    {
+        for (auto i = std::size_t(0); i < width; ++i) out[i] = static_cast<unsigned char>(value >> (8*i));
+    }
+};
+
+struct BinaryMarketDataSink : MarketDataSink
+{
+    void levelUpdate(L2Update const & update) override
+    {
+        unsigned char record[L2Codec::RecordSize];
+        L2Codec::encodeUpdate(update, record);
+        mOutput.append(reinterpret_cast<char const *>(record), L2Codec::RecordSize);
+    }
+    void endOfUpdates(uint64_t lastSequence) override
+    {
+        unsigned char record[L2Codec::RecordSize];
+        L2Codec::encodeEnd(lastSequence, record);
+        mOutput.append(reinterpret_cast<char const *>(record), L2Codec::RecordSize);
+    }
+    void flush() override {mOutput.flush();}
+
+    explicit BinaryMarketDataSink(std::FILE * output):mOutput(output){}
+    BinaryMarketDataSink(BinaryMarketDataSink const &)             = delete;
+    BinaryMarketDataSink & operator=(BinaryMarketDataSink const &) = delete;
+    ~BinaryMarketDataSink(){mOutput.flush();}
+private:
+    OutputBuffer mOutput;
+};
+
+#endif
@@ -0,0 +1,366 @@
+#ifndef MATCHINGENGINE_MATCHINGENGINE_H
+#define MATCHINGENGINE_MATCHINGENGINE_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstring>
+
+#include "objectsemantics.h"
+#include "messagereader.h"
+#include "binaryprotocol.h"
+#include "textprotocol.h"
+#include "orderbook.h"
+#include "enginestats.h"
+#include "journal.h"
+#include "snapshot.h"
+#include "bookview.h"
+
+struct RecoveryResult
+{
+    bool     SnapshotLoaded;
+    uint64_t SnapshotOrders;
+    uint64_t JournalEvents;  //replayed from the tail past the snapshot
+    uint64_t JournalBytes;   //the journal's valid length; hand it to the JournalWriter that continues it
+    bool     JournalRejected; //a name record disagreed with the handles held; replay stopped there, and
+                              //the engine and journal are not to be carried on with
+};
+
+struct MatchingEngine
+{
+    void processNextMessage(std::string const & message)
+    {
+        processNextMessage(Token(message.data(), message.size()));
+    }
+    void processNextMessage(Token const & message)
+    {//tokens point straight into the message, which only has to outlive this call;
+        //ids are interned here, once, and everything past this point works on handles
+        MATCHINGENGINE_STAT(auto const start = readTicks());
+        auto const command = decodeMessage(message);
+        processCommand(command);
+        MATCHINGENGINE_STAT(recordMessage(command.Type, start));
+        endOfMessage();
+    }
+    Command decodeMessage(Token const & message)
+    {//processNextMessage's decoding on its own, for processBatch: a new id is interned
+        //now, so later messages in the same batch already know it
+        mMessageTokens.tokenize(message.Data, message.Size);
+        return decodeTextMessage(mMessageTokens, mOrderBook.orderIds());
+    }
+    template <typename TextReader>
+    void processMessages(TextReader & reader)
+    {//any reader with nextMessage(Token &): MessageReader, MappedMessageReader;
+        //decoded and run setBatchSize messages at a time; a batch also ends at an
+        //END_OF_DAY, as that forgets the session's ids, and the messages after it
+        //have to be decoded against the next session's
+        auto message = Token();
+        if (mBatchSize==1)
+        {
+            while (reader.nextMessage(message)) processNextMessage(message);
+            return;
+        }
+        while (reader.nextMessage(message))
+        {
+            mBatch.push_back(decodeMessage(message));
+            if (mBatch.size()==mBatchSize || mBatch.back().Type==CommandType::EndOfDay) runBatch();
+        }
+        runBatch();
+    }
+    //binary path: records are already decoded into fixed fields, so there are no string compares
+    void processBinaryMessage(unsigned char const * record)
+    {
+        processMessage(BinaryCodec::decode(record));
+    }
+    void processMessage(Command const & command)
+    {//a message already decoded, from either protocol, with its end-of-message work
+        MATCHINGENGINE_STAT(auto const start = readTicks());
+        processCommand(command);
+        MATCHINGENGINE_STAT(recordMessage(command.Type, start));
+        endOfMessage();
+    }
+    void processMessages(BinaryMessageReader & reader)
+    {//batched as text is, ending a batch at an END_OF_DAY too: the handles after it
+        //name the next session's orders, so the lookahead mustn't fetch for them
+        //against this session's book
+        auto record = static_cast<unsigned char const *>(nullptr);
+        if (mBatchSize==1)
+        {
+            while (reader.nextRecord(record)) processBinaryMessage(record);
+            return;
+        }
+        while (reader.nextRecord(record))
+        {
+            mBatch.push_back(BinaryCodec::decode(record));
+            if (mBatch.size()==mBatchSize || mBatch.back().Type==CommandType::EndOfDay) runBatch();
+        }
+        runBatch();
+    }
+    void processBatch(Command const * commands, std::size_t count)
+    {//messages already decoded, run in order; while one runs, the finders, orders and
+        //levels that those a few places behind it will want are fetched (see
+        //OrderBook::prefetchFinder), so a burst of cancels doesn't take a cache miss
+        //at every step; the report sink sees one end of message for the whole batch,
+        //so a sink that flushes per message flushes once
+        //the pool index prefetchOrder finds is kept, in a ring of OrderLookahead, for
+        //the same command's prefetchLevel, so each command's finder is probed once
+        pool_index_t orders[OrderLookahead];
+        for (auto i = std::size_t(0); i < count && i < FinderLookahead; ++i) mOrderBook.prefetchFinder(commands[i]);
+        for (auto i = LevelLookahead; i < count && i < OrderLookahead; ++i) orders[i] = mOrderBook.prefetchOrder(commands[i]);
+        for (auto i = std::size_t(0); i < count; ++i)
+        {
+            auto const order = i + OrderLookahead, level = i + LevelLookahead;
+            if (i + FinderLookahead < count) mOrderBook.prefetchFinder(commands[i + FinderLookahead]);
+            if (order < count) orders[order % OrderLookahead] = mOrderBook.prefetchOrder(commands[order]);
+            if (level < count) mOrderBook.prefetchLevel(commands[level], orders[level % OrderLookahead]);
+            MATCHINGENGINE_STAT(auto const start = readTicks());
+            processCommand(commands[i]);
+            MATCHINGENGINE_STAT(recordMessage(commands[i].Type, start));
+            endOfCommand();
+        }
+        if (count != 0) endOfBatch();
+    }
+    void setBatchSize(std::size_t batchSize)
+    {//how many messages processMessages decodes before running them as a batch; 1 runs each as it comes
+        mBatchSize = batchSize ? batchSize : 1;
+        mBatch.reserve(mBatchSize);
+    }
+    void processCommand(Command const & command)
+    {
+        switch (command.Type)
+        {
+            case CommandType::Buy:    journal(command); mOrderBook.processNewBuyOrder(Order(command)); break;
+            case CommandType::Sell:   journal(command); mOrderBook.processNewSelOrder(Order(command)); break;
+            case CommandType::Modify:
+                journal(command);
+                mOrderBook.processMod(command.OrderHandle, command.Side, command.Price, command.Quantity);
+                break;
+            case CommandType::Cancel: journal(command); mOrderBook.processCancel(command.OrderHandle); break;
+            case CommandType::Print:  printBook(); break;
+            case CommandType::Stats:  if (mSessionLog) printStats(*mSessionLog); break;
+            case CommandType::EndOfDay: journal(command); endSession(); break;
+            case CommandType::Auction:  journal(command); mOrderBook.startAuction(); break;
+            case CommandType::Uncross:  journal(command); uncross(); break;
+            default: ; //unknown record type; ignored like an unknown text message
+        }
+    }
+    void setMarketDataSink(MarketDataSink * marketData, std::size_t messagesPerPublish = 1)
+    {//L2 deltas go out after every messagesPerPublish messages, and on publishMarketData()
+        mOrderBook.setMarketDataSink(marketData);
+        mMessagesPerPublish = messagesPerPublish ? messagesPerPublish : 1;
+        mUnpublished        = 0;
+    }
+    void publishMarketData()
+    {
+        mOrderBook.publishLevelChanges();
+        mUnpublished = 0;
+    }
+    void setSessionLog(std::ostream * log) {mSessionLog = log;} //where END_OF_DAY, UNCROSS and STATS report; nullptr for nowhere
+    void setBookView(SeqlockBookView * view)
+    {//published after every message, or once per batch, for other threads to read;
+        //nullptr stops publishing
+        mBookView = view;
+        if (mBookView) mBookView->publish(mOrderBook, mMessages);
+    }
+    void setJournal(JournalWriter * journal, char const * snapshotPath = nullptr, std::size_t eventsPerSnapshot = 0)
+    {//every accepted event is appended to journal before it is applied; with a
+        //snapshotPath, a snapshot is taken after every eventsPerSnapshot of them
+        mJournal           = journal;
+        mSnapshotPath      = snapshotPath ? snapshotPath : "";
+        mEventsPerSnapshot = snapshotPath ? eventsPerSnapshot : 0;
+        mUnsnapshotted     = 0;
+    }
+    bool takeSnapshot()
+    {//syncs the journal first, so the snapshot never gets ahead of it; none is taken
+        //while an auction collects, as a snapshot holds the book but not its mode (the
+        //journal from the last one replays the AUCTION too)
+        if (!mJournal || mSnapshotPath.empty() || mOrderBook.collecting()) return false;
+        mUnsnapshotted = 0;
+        if (!mJournal->sync())
+        {
+            journalFailed();
+            return false;
+        }
+        return writeSnapshot(mOrderBook, mSnapshotPath.c_str(), mJournal->position());
+    }
+    RecoveryResult recover(char const * snapshotPath, char const * journalPath)
+    {//into a fresh engine, before any messages or sinks: loads the snapshot if there
+        //is a complete one, then replays the journal from where it left off; trades
+        //replayed were reported the first time round, so they go nowhere now
+        auto result   = RecoveryResult{false, 0, 0, 0, false};
+        auto position = uint64_t(0);
+        if (snapshotPath)
+        {
+            MappedFile snapshot(snapshotPath);
+            result.SnapshotLoaded = loadSnapshot(mOrderBook, snapshot, position);
+            result.SnapshotOrders = mOrderBook.orderPoolStats().Live;
+        }
+        MappedFile journalFile(journalPath);
+        if (position > journalFile.size()) position = journalFile.size(); //journal lost its tail; keep what there is
+        NullReportSink quiet;
+        auto const journal = mJournal;
+        mJournal = nullptr;
+        mOrderBook.setReportSink(quiet);
+        auto const sessionLog = mSessionLog;
+        mSessionLog = nullptr; //those sessions were reported the first time round too
+        auto reader  = JournalReader(journalFile, position);
+        auto command = Command();
+        auto handle  = order_handle_t();
+        auto orderID = Token();
+        for (;;)
+        {
+            auto const entry = reader.next(command, handle, orderID);
+            if (entry==JournalReader::Entry::End) break;
+            if (entry==JournalReader::Entry::Name && !mOrderBook.orderIds().restore(handle, orderID))
+            {//the id is held at another handle, or the handle by another id: what follows
+                //would mean something else than it did
+                result.JournalRejected = true;
+                break;
+            }
+            if (entry==JournalReader::Entry::Command) processCommand(command);
+            ++result.JournalEvents;
+        }
+        mOrderBook.setReportSink(*mReports);
+        mSessionLog = sessionLog;
+        mJournal = journal;
+        result.JournalBytes = reader.position();
+        return result;
+    }
+    PoolStats orderPoolStats() const {return mOrderBook.orderPoolStats();}
+    MemoryReport memory()      const {return mOrderBook.memory();}
+    std::size_t snapshot(OrderSide side, LevelSnapshot * levels, std::size_t depth) const
+    {
+        return mOrderBook.snapshot(side, levels, depth);
+    }
+    void printStats(std::ostream & os) const
+    {//only reads counters, so a STATS message can come at any point in the flow
+        os << "STATS" << std::endl;
+#ifdef MATCHINGENGINE_STATS
+        printHistogramHeader(os, "message (t)");
+        for (auto t = std::size_t(0); t < MessageTypes; ++t)
+        {
+            if (mMessageTicks[t].count() != 0) printHistogramRow(os, messageTypeName(t), mMessageTicks[t]);
+        }
+        os << mOrderBook.stats();
+#else
+        os << "instrumentation not compiled in (make STATS=1)" << std::endl;
+#endif
+        os << mOrderBook.memory() << std::endl;
+    }
+    
+    //reports receives every trade and printed level, and must outlive the engine;
+    //band and orderCapacity size the book (see OrderBook)
+    explicit MatchingEngine(ExecutionReportSink & reports, PriceBand band = defaultPriceBand(),
+                            std::size_t orderCapacity = MATCHINGENGINE_ORDER_CAPACITY)
+    :mOrderBook(reports, band, orderCapacity), mMessageTokens(), mReports(&reports),
+    mMessagesPerPublish(1), mUnpublished(0),
+    mJournal(nullptr), mJournalFailed(false), mSnapshotPath(), mEventsPerSnapshot(0), mUnsnapshotted(0), mBatchSize(1), mBatch(),
+    mMessages(0), mBookView(nullptr), mSessionLog(&std::cerr){}
+    DEFAULT_OBJECT_SEMANTICS(MatchingEngine)
+    ~MatchingEngine(){}
+private:
+    void printBook(){mOrderBook.printBook();}
+    void endSession()
+    {//the book rolls over without visiting its orders (see OrderBook::endSession);
+        //the report says what this session needed, and how long the reset took
+        auto const start = readTicks();
+        auto const stats = mOrderBook.endSession();
+        auto const ticks = readTicks() - start;
+        if (mSessionLog) *mSessionLog << "END_OF_DAY " << stats << ", reset in " << ticks << " ticks" << std::endl;
+    }
+    void uncross()
+    {
+        auto const result = mOrderBook.uncross();
+        if (mSessionLog) *mSessionLog << "UNCROSS price " << result.Price << " volume " << result.Volume << std::endl;
+    }
+    void endOfMessage()
+    {
+        endOfCommand();
+        endOfBatch();
+    }
+    void endOfCommand()
+    {//L2 and snapshots still count every message of a batch
+        ++mMessages;
+        if (++mUnpublished >= mMessagesPerPublish) publishMarketData();
+        if (mEventsPerSnapshot != 0 && mUnsnapshotted >= mEventsPerSnapshot) takeSnapshot();
+    }
+    void endOfBatch()
+    {//once per batch, and after every message outside one
+        if (mBookView) mBookView->publish(mOrderBook, mMessages);
+        mReports->endOfMessage();
+    }
+    void runBatch()
+    {
+        processBatch(mBatch.data(), mBatch.size());
+        mBatch.clear();
+    }
+    void journal(Command const & command)
+    {//a new order is preceded by its id's name, so replay gives the id the same handle,
+        //unless that handle is resting: then a snapshot has the name, or the journal
+        //named it when it came to rest; a snapshot keeps no other ids, so one taken up
+        //again after its order has gone is named anew
+        if (!mJournal) return;
+        if (command.Type==CommandType::Buy || command.Type==CommandType::Sell)
+        {
+            auto const & orderIds = mOrderBook.orderIds();
+            auto const handle     = command.OrderHandle;
+            if (orderIds.contains(handle) && !mOrderBook.resting(handle) && !mJournal->appendName(handle, orderIds.name(handle)))
+            {
+                journalFailed();
+            }
+        }
+        if (!mJournal->append(command)) journalFailed();
+        ++mUnsnapshotted;
+    }
+    void journalFailed()
+    {//the records stay buffered, and every commit tries them again; said once, as a
+        //journal that can't be written must not go unnoticed
+        if (mJournalFailed) return;
+        mJournalFailed = true;
+        std::cerr << "journal write failed: " << std::strerror(mJournal->error()) << "; records kept for the next commit"
+                  << std::endl;
+    }
+
+    //how far ahead of the running command each lookahead step works
+    static constexpr std::size_t FinderLookahead = 8;
+    static constexpr std::size_t OrderLookahead  = 4;
+    static constexpr std::size_t LevelLookahead  = 2;
+
+#ifdef MATCHINGENGINE_STATS
+    //per message type tick histograms, indexed by CommandType; 0 collects anything
+    //unrecognised, including a MODIFY or CANCEL of an id never seen
+    static constexpr std::size_t MessageTypes = static_cast<std::size_t>(CommandType::Uncross) + 1;
+
+    static char const * messageTypeName(std::size_t type)
+    {
+        static char const * const names[MessageTypes] = {"other", "BUY", "SELL", "MODIFY", "CANCEL", "PRINT", "STATS", "END_OF_DAY",
+                                                         "AUCTION", "UNCROSS"};
+        return names[type];
+    }
+    void recordMessage(CommandType type, uint64_t start)
+    {
+        auto const index = static_cast<std::size_t>(type);
+        mMessageTicks[index < MessageTypes ? index : 0].record(readTicks() - start);
+    }
+#endif
+private:
+    OrderBook             mOrderBook;
+    message_tokens_t      mMessageTokens; //reused for every message
+    ExecutionReportSink * mReports;
+#ifdef MATCHINGENGINE_STATS
+    LatencyHistogram      mMessageTicks[MessageTypes];
+#endif
+    std::size_t           mMessagesPerPublish;
+    std::size_t           mUnpublished;        //messages since the last L2 publish
+    JournalWriter *       mJournal;            //nullptr when not journaling
+    bool                  mJournalFailed;      //reported a failed commit already
+    std::string           mSnapshotPath;
+    std::size_t           mEventsPerSnapshot;  //0 for no periodic snapshots
+    std::size_t           mUnsnapshotted;      //events journaled since the last snapshot
+    std::size_t           mBatchSize;
+    std::vector<Command>  mBatch;              //decoded, waiting to run
+    uint64_t              mMessages;           //processed, counting batched ones
+    SeqlockBookView *     mBookView;           //nullptr when nobody reads one
+    std::ostream *        mSessionLog;         //END_OF_DAY, UNCROSS and STATS reports; nullptr for none
+};//end MatchingEngine
+
+#endif
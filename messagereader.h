@@ -0,0 +1,245 @@
+#ifndef MATCHINGENGINE_MESSAGEREADER_H
+#define MATCHINGENGINE_MESSAGEREADER_H
+
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+struct Token
+{//non-owning view of a run of bytes in the reader's buffer
+    //only valid until the next message is read, so anything kept must be copied out
+    char const * Data;
+    std::size_t  Size;
+    
+    bool operator==(char const * literal) const
+    {//lengths first, so a token with a NUL in it is never read past the literal
+        return Size==std::strlen(literal) && std::memcmp(Data, literal, Size)==0;
+    }
+    bool operator!=(char const * literal) const {return !(*this==literal);}
+    std::string str() const {return std::string(Data, Size);}
+    bool toUnsigned(uint64_t & value) const
+    {//only a token of nothing but decimal digits whose value fits parses; a sign,
+        //anything after the digits, an empty token or overflow return false, and
+        //leave value alone
+        if (Size==0) return false;
+        auto parsed = uint64_t(0);
+        for (auto i = std::size_t(0); i < Size; ++i)
+        {
+            auto const digit = static_cast<unsigned>(Data[i] - '0');
+            if (digit > 9 || parsed > (uint64_t(-1) - digit)/10) return false;
+            parsed = parsed*10 + digit;
+        }
+        value = parsed;
+        return true;
+    }
+    
+    Token():Data(nullptr), Size(0){}
+    Token(char const * data, std::size_t size):Data(data), Size(size){}
+};
+
+struct MessageTokens
+{//fixed capacity so splitting a message never touches the heap
+    static constexpr std::size_t MaxTokens = 8;
+    
+    Token const & at(std::size_t i) const
+    {
+        if (i >= mCount) throw std::out_of_range("MessageTokens::at");
+        return mTokens[i];
+    }
+    Token const & front() const {return at(0);}
+    std::size_t   size()  const {return mCount;}
+    
+    void tokenize(char const * message, std::size_t messageSize)
+    {//split on single spaces; extra tokens beyond MaxTokens are folded into the last one
+        mCount         = 0;
+        auto tokenStart = std::size_t(0);
+        for (auto i = std::size_t(0); i < messageSize && mCount < MaxTokens - 1; ++i)
+        {
+            if (message[i]==' ')
+            {
+                mTokens[mCount++] = Token(message + tokenStart, i - tokenStart);
+                tokenStart = i + 1;
+            }
+        }
+        mTokens[mCount++] = Token(message + tokenStart, messageSize - tokenStart);
+    }
+    
+    MessageTokens():mTokens(), mCount(0){}
+private:
+    Token       mTokens[MaxTokens];
+    std::size_t mCount;
+};
+
+using message_tokens_t = MessageTokens;
+
+inline Token trimmedLine(char const * line, std::size_t size)
+{//tolerate CRLF input
+    if (size != 0 && line[size - 1]=='\r') --size;
+    return Token(line, size);
+}
+
+struct MessageReader
+{//pulls newline-delimited messages out of a FILE through one large reusable buffer
+    //nextMessage hands back a view into that buffer, so the previous message
+    //is invalidated by each call; a line longer than the buffer grows it
+    static constexpr std::size_t DefaultBufferSize = 1 << 20;
+    
+    bool nextMessage(Token & message)
+    {
+        for (;;)
+        {
+            auto const begin   = mBuffer.data() + mBegin;
+            auto const newline = static_cast<char const *>(std::memchr(begin, '\n', mEnd - mBegin));
+            if (newline)
+            {
+                message = trimmedLine(begin, newline - begin);
+                mBegin  = (newline - mBuffer.data()) + 1;
+                return true;
+            }
+            if (mEof)
+            {
+                if (mBegin==mEnd) return false;
+                message = trimmedLine(begin, mEnd - mBegin);
+                mBegin  = mEnd;
+                return true;
+            }
+            refill();
+        }
+    }
+    
+    explicit MessageReader(std::FILE * input, std::size_t bufferSize = DefaultBufferSize)
+    :mInput(input), mBuffer(bufferSize), mBegin(0), mEnd(0), mEof(false){}
+    MessageReader(MessageReader const &)             = delete;
+    MessageReader & operator=(MessageReader const &) = delete;
+    ~MessageReader(){}
+private:
+    void refill()
+    {//slide the partial line to the front, then fill the rest of the buffer
+        auto const partial = mEnd - mBegin;
+        if (partial != 0 && mBegin != 0) std::memmove(mBuffer.data(), mBuffer.data() + mBegin, partial);
+        mBegin = 0;
+        mEnd   = partial;
+        if (mEnd==mBuffer.size()) mBuffer.resize(mBuffer.size()*2);
+        auto const bytesRead = std::fread(mBuffer.data() + mEnd, 1, mBuffer.size() - mEnd, mInput);
+        mEnd += bytesRead;
+        if (bytesRead==0) mEof = true;
+    }
+    
+    std::FILE *        mInput;
+    std::vector<char>  mBuffer;
+    std::size_t        mBegin;
+    std::size_t        mEnd;
+    bool               mEof;
+};
+
+//newlines a 64 byte block at a time: one bit per byte, set where there's a newline
+namespace newline_detail
+{
+constexpr std::size_t BlockSize = 64;
+
+inline uint64_t scalarMask(char const * block, std::size_t size)
+{//for a short tail, or where there's nothing wider
+    auto mask = uint64_t(0);
+    for (auto i = std::size_t(0); i < size; ++i)
+    {
+        if (block[i]=='\n') mask |= uint64_t(1) << i;
+    }
+    return mask;
+}
+#if defined(__SSE2__)
+inline uint64_t sse2Mask(char const * block)
+{
+    auto const newline = _mm_set1_epi8('\n');
+    auto mask = uint64_t(0);
+    for (auto i = 0; i < 4; ++i)
+    {
+        auto const bytes = _mm_loadu_si128(reinterpret_cast<__m128i const *>(block + 16*i));
+        mask |= uint64_t(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline)))) << (16*i);
+    }
+    return mask;
+}
+__attribute__((target("avx2"))) inline uint64_t avx2Mask(char const * block)
+{//compiled for AVX2 whatever the build flags, and only called where the cpu has it
+    auto const newline = _mm256_set1_epi8('\n');
+    auto const low     = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(block));
+    auto const high    = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(block + 32));
+    return uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, newline)))) |
+           uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, newline)))) << 32;
+}
+#endif
+}
+
+struct MappedMessageReader
+{//MessageReader's messages, straight out of memory that's already there, such as a
+    //mapped file: tokens point into it and nothing is copied. Rather than one memchr
+    //per (typically 20 byte) line, each 64 byte block is compared once, with AVX2 or
+    //SSE2 where there is one, and its lines come off the resulting bit mask
+    bool nextMessage(Token & message)
+    {
+        while (mMask==0)
+        {
+            if (mScanned==mSize)
+            {//a last line without a newline still counts
+                if (mBegin==mSize) return false;
+                message = trimmedLine(mData + mBegin, mSize - mBegin);
+                mBegin  = mSize;
+                ++mMessages;
+                return true;
+            }
+            scanBlock();
+        }
+        auto const newline = mBlock + static_cast<std::size_t>(__builtin_ctzll(mMask));
+        mMask  &= mMask - 1;
+        message = trimmedLine(mData + mBegin, newline - mBegin);
+        mBegin  = newline + 1;
+        ++mMessages;
+        return true;
+    }
+    uint64_t messages() const {return mMessages;} //handed out so far
+
+    MappedMessageReader(char const * data, std::size_t size)
+    :mData(data), mSize(size), mBegin(0), mBlock(0), mScanned(0), mMask(0), mMessages(0), mAvx2(false)
+    {
+#if defined(__SSE2__)
+        mAvx2 = __builtin_cpu_supports("avx2");
+#endif
+    }
+    MappedMessageReader(MappedMessageReader const &)             = delete;
+    MappedMessageReader & operator=(MappedMessageReader const &) = delete;
+    ~MappedMessageReader(){}
+private:
+    void scanBlock()
+    {//never reads past mSize, so the data needs no padding
+        using namespace newline_detail;
+        auto const block = mData + mScanned;
+        auto const size  = (mSize - mScanned < BlockSize) ? mSize - mScanned : BlockSize;
+        mBlock = mScanned;
+        mScanned += size;
+#if defined(__SSE2__)
+        if (size==BlockSize)
+        {
+            mMask = mAvx2 ? avx2Mask(block) : sse2Mask(block);
+            return;
+        }
+#endif
+        mMask = scalarMask(block, size);
+    }
+
+    char const * mData;
+    std::size_t  mSize;
+    std::size_t  mBegin;    //start of the next message
+    std::size_t  mBlock;    //start of the block mMask describes
+    std::size_t  mScanned;  //end of that block
+    uint64_t     mMask;     //its newlines not handed out yet
+    uint64_t     mMessages;
+    bool         mAvx2;
+};
+
+#endif
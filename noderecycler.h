@@ -0,0 +1,177 @@
+#ifndef MATCHINGENGINE_NODERECYCLER_H
+#define MATCHINGENGINE_NODERECYCLER_H
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include <new>
+#include <cstdint>
+
+//a std::map allocates one node per element, so a book side whose levels come and
+//go (a level emptied by a fill or a cancel, then another opened a tick away)
+//would otherwise go to the heap and back for every one; NodeRecycler carves its
+//nodes from blocks, puts freed ones on a free list threaded through the nodes
+//themselves, and hands them out again before carving more; recycleAll() takes
+//every node back at once, none of them visited, so a map whose elements need no
+//destructor can be emptied in O(1) (recycleAll(map, recycler)); blocks only go
+//back to the heap there, beyond RetainLimit nodes' worth, so a burst of levels
+//pins its memory until the end of the session, not the rest of the run
+
+#ifndef MATCHINGENGINE_RETAINED_LEVELS
+#define MATCHINGENGINE_RETAINED_LEVELS 4096
+#endif
+
+struct RecyclerStats
+{
+    std::size_t NodeSize;        //bytes per node, as the container asks for them; 0 before the first
+    std::size_t Live;            //nodes handed out
+    std::size_t Retained;        //nodes' worth held in blocks but not handed out: freed, or not carved yet
+    std::size_t RetainLimit;     //nodes' worth of blocks kept through recycleAll()
+    uint64_t    HeapAllocations; //operator new calls: blocks, and anything not node sized
+    uint64_t    HeapFrees;       //operator delete calls
+    uint64_t    Recycled;        //allocations served from a freed node, or a block kept through recycleAll()
+};
+
+inline std::ostream & operator<<(std::ostream & os, RecyclerStats const & stats)
+{
+    return os << "live "         << stats.Live
+              << " retained "    << stats.Retained << "/" << stats.RetainLimit
+              << " node bytes "  << stats.NodeSize
+              << " heap allocs " << stats.HeapAllocations
+              << " frees "       << stats.HeapFrees
+              << " recycled "    << stats.Recycled;
+}
+
+struct NodeRecycler
+{//nodes of one size (whatever the first allocation asked for), NodesPerBlock to
+    //a block; any other size goes straight to the heap and back
+    static constexpr std::size_t NodesPerBlock = 64;
+
+    void * allocate(std::size_t bytes)
+    {
+        if (mStats.NodeSize==0 && bytes >= sizeof(FreeNode)) mStats.NodeSize = bytes;
+        if (bytes != mStats.NodeSize)
+        {
+            ++mStats.HeapAllocations;
+            return ::operator new(bytes);
+        }
+        void * node;
+        if (mFree)
+        {
+            node  = mFree;
+            mFree = mFree->Next;
+            ++mStats.Recycled;
+        }
+        else
+        {
+            if (mCarved==mBlocks.size()*NodesPerBlock) addBlock();
+            if (mCarved < mReusable) ++mStats.Recycled;
+            node = static_cast<char *>(mBlocks[mCarved/NodesPerBlock]) + (mCarved%NodesPerBlock)*mStats.NodeSize;
+            ++mCarved;
+        }
+        ++mStats.Live;
+        --mStats.Retained;
+        return node;
+    }
+    void deallocate(void * block, std::size_t bytes)
+    {
+        if (bytes != mStats.NodeSize)
+        {
+            ++mStats.HeapFrees;
+            ::operator delete(block);
+            return;
+        }
+        mFree = new (block) FreeNode{mFree};
+        --mStats.Live;
+        ++mStats.Retained;
+    }
+    void recycleAll()
+    {//every node handed out is taken back at once: the free list is forgotten and
+        //carving starts again from the first block; only the blocks beyond RetainLimit
+        //are visited, to free them, and each of those was paid for when it was added
+        auto const keep = std::min(mBlocks.size(), (mStats.RetainLimit + NodesPerBlock - 1)/NodesPerBlock);
+        while (mBlocks.size() > keep)
+        {
+            ::operator delete(mBlocks.back());
+            mBlocks.pop_back();
+            ++mStats.HeapFrees;
+        }
+        mReusable       = std::min(std::max(mReusable, mCarved), keep*NodesPerBlock);
+        mFree           = nullptr;
+        mCarved         = 0;
+        mStats.Live     = 0;
+        mStats.Retained = keep*NodesPerBlock;
+    }
+    RecyclerStats const & stats() const {return mStats;}
+
+    explicit NodeRecycler(std::size_t retainLimit = MATCHINGENGINE_RETAINED_LEVELS)
+    :mBlocks(), mFree(nullptr), mCarved(0), mReusable(0), mStats{0, 0, 0, retainLimit, 0, 0, 0}{}
+    NodeRecycler(NodeRecycler const &)             = delete; //allocators point at it
+    NodeRecycler & operator=(NodeRecycler const &) = delete;
+    ~NodeRecycler()
+    {
+        for (auto block : mBlocks) ::operator delete(block);
+    }
+private:
+    struct FreeNode
+    {
+        FreeNode * Next;
+    };
+
+    void addBlock()
+    {
+        mBlocks.push_back(::operator new(NodesPerBlock*mStats.NodeSize));
+        ++mStats.HeapAllocations;
+        mStats.Retained += NodesPerBlock;
+    }
+
+    std::vector<void *> mBlocks;
+    FreeNode *          mFree;
+    std::size_t         mCarved;   //nodes carved from the blocks since the last recycleAll()
+    std::size_t         mReusable; //of those, how many a session before this one had carved too
+    RecyclerStats       mStats;
+};
+constexpr std::size_t NodeRecycler::NodesPerBlock;
+
+template <typename T>
+struct RecyclingAllocator
+{//points at a recycler its owner keeps alongside the container, declared before it
+    //so it outlives the container's nodes; every copy and rebinding shares it
+    using value_type = T;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap            = std::true_type;
+
+    T * allocate(std::size_t n) {return static_cast<T *>(mRecycler->allocate(n*sizeof(T)));}
+    void deallocate(T * p, std::size_t n) {mRecycler->deallocate(p, n*sizeof(T));}
+    RecyclerStats const & stats() const {return mRecycler->stats();}
+
+    explicit RecyclingAllocator(NodeRecycler & recycler):mRecycler(&recycler){}
+    template <typename U>
+    RecyclingAllocator(RecyclingAllocator<U> const & other):mRecycler(other.mRecycler){}
+private:
+    template <typename> friend struct RecyclingAllocator;
+    template <typename U, typename V>
+    friend bool operator==(RecyclingAllocator<U> const & a, RecyclingAllocator<V> const & b);
+
+    NodeRecycler * mRecycler;
+};
+
+template <typename T, typename U>
+bool operator==(RecyclingAllocator<T> const & a, RecyclingAllocator<U> const & b) {return a.mRecycler==b.mRecycler;}
+template <typename T, typename U>
+bool operator!=(RecyclingAllocator<T> const & a, RecyclingAllocator<U> const & b) {return !(a==b);}
+
+template <typename Map>
+void recycleAll(Map & map, NodeRecycler & recycler)
+{//empties a map whose nodes all came from recycler in O(1): the recycler takes them
+    //back, and a new empty map is made over the old one, whose destructor would only
+    //have handed them back one by one
+    static_assert(std::is_trivially_destructible<typename Map::value_type>::value,
+                  "the elements' destructors would be skipped");
+    auto const compare = map.key_comp();
+    recycler.recycleAll();
+    ::new (static_cast<void *>(&map)) Map(compare, typename Map::allocator_type(recycler));
+}
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef MATCHINGENGINE_OBJECTSEMANTICS_H
+#define MATCHINGENGINE_OBJECTSEMANTICS_H
+
+//move-only: the engine's types own books and buffers we never want copied by accident
+#define DEFAULT_OBJECT_SEMANTICS(TYPE)    \
+TYPE(TYPE const &)             = delete;  \
+TYPE & operator=(TYPE const &) = delete;  \
+TYPE(TYPE&&)                   = default; \
+TYPE & operator=(TYPE&&)       = default; \
+
+#endif
@@ -0,0 +1,721 @@
+#ifndef MATCHINGENGINE_ORDERBOOK_H
+#define MATCHINGENGINE_ORDERBOOK_H
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <type_traits>
+
+#include "objectsemantics.h"
+#include "binaryprotocol.h"
+#include "booksides.h"
+#include "orderindex.h"
+#include "slabpool.h"
+#include "reportsink.h"
+#include "enginestats.h"
+#include "marketdata.h"
+
+struct Order
+{//a plain record, so the pool can hand these out without constructing anything
+    uint64_t       Price;
+    uint64_t       Quantity;
+    order_handle_t ID;
+    pool_index_t   Prev; //intrusive links for the level's OrderQueue; NoPoolIndex at the ends
+    pool_index_t   Next;
+    OrderSide      Side;
+    TimeInForce    TIF;
+
+    //built from a decoded command, text or binary, whose id is already a handle
+    explicit Order(Command const & command)
+    :Price       (command.Price),
+    Quantity    (command.Quantity),
+    ID          (command.OrderHandle),
+    Prev        (NoPoolIndex),
+    Next        (NoPoolIndex),
+    Side        (command.Side),
+    TIF         (command.TIF)
+    {}
+    Order() = default; //left uninitialised for the pool
+};
+static_assert(sizeof(Order) <= 32, "keep Order to half a cache line");
+static_assert(std::is_trivially_copyable<Order>::value, "Order must stay a plain record");
+
+using order_pool_t = SlabPool<Order>;
+
+struct OrderQueue
+{//time-ordered orders at one price, linked through the orders themselves so that
+    //removing any of them is O(1) and never moves the others; the links are pool
+    //indices, so every operation that follows them is handed the pool
+    //the level's total quantity and order count are kept up to date as orders
+    //come, go and fill, so reading them never walks the queue
+    bool         empty()    const {return mHead==NoPoolIndex;}
+    pool_index_t front()    const {return mHead;}
+    uint64_t     quantity() const {return mQuantity;}
+    uint64_t     size()     const {return mOrders;}
+    void push_back(order_pool_t & orders, pool_index_t index)
+    {
+        auto & order = orders[index];
+        order.Prev = mTail;
+        order.Next = NoPoolIndex;
+        if (mTail != NoPoolIndex) orders[mTail].Next = index;
+        else                      mHead              = index;
+        mTail = index;
+        mQuantity += order.Quantity;
+        ++mOrders;
+    }
+    void unlink(order_pool_t & orders, pool_index_t index)
+    {//takes the order's remaining quantity out of the level's total
+        auto & order = orders[index];
+        if (order.Prev != NoPoolIndex) orders[order.Prev].Next = order.Next;
+        else                           mHead                   = order.Next;
+        if (order.Next != NoPoolIndex) orders[order.Next].Prev = order.Prev;
+        else                           mTail                   = order.Prev;
+        order.Prev = order.Next = NoPoolIndex;
+        mQuantity -= order.Quantity;
+        --mOrders;
+    }
+    void reduce(uint64_t quantity) {mQuantity -= quantity;} //a resting order here has shrunk by quantity
+    template <typename Fn>
+    void forEach(order_pool_t const & orders, Fn && fn) const
+    {//fn(index, order), front to back
+        for (auto index = mHead; index != NoPoolIndex; index = orders[index].Next) fn(index, orders[index]);
+    }
+
+    OrderQueue():mHead(NoPoolIndex), mTail(NoPoolIndex), mQuantity(0), mOrders(0){}
+private:
+    pool_index_t mHead;
+    pool_index_t mTail;
+    uint64_t     mQuantity;
+    uint64_t     mOrders;
+};
+
+struct LevelSnapshot
+{
+    price_t  Price;
+    uint64_t Quantity;
+    uint64_t Orders;
+};
+
+struct SessionStats
+{//one session's memory, taken at its close
+    uint64_t    Session;    //numbered from 0
+    PoolStats   Orders;     //Live is what expired at the close, HighWater this session's peak
+    std::size_t IndexSlots; //the order index's slot array, kept for the next session
+};
+
+inline std::ostream & operator<<(std::ostream & os, SessionStats const & stats)
+{
+    return os << "session " << stats.Session << " orders " << stats.Orders << " index slots " << stats.IndexSlots;
+}
+
+struct MemoryReport
+{//what the book holds against what it's using, for sizing it to a flow
+    PoolStats      Orders;     //ElementSize is the bytes per order
+    std::size_t    IndexBytes; //the order index's slots
+    std::size_t    IdBytes;    //the interned order ids; these last a session
+    BookSideMemory Bids;
+    BookSideMemory Asks;
+};
+
+inline std::ostream & operator<<(std::ostream & os, MemoryReport const & memory)
+{
+    return os << "orders " << memory.Orders << " order bytes " << memory.Orders.ElementSize << std::endl
+              << "index bytes " << memory.IndexBytes << " id bytes " << memory.IdBytes << std::endl
+              << "bids " << memory.Bids << std::endl
+              << "asks " << memory.Asks;
+}
+
+struct AuctionResult
+{//what an uncross did
+    price_t  Price;  //the clearing price; 0 if the book wasn't crossed
+    uint64_t Volume; //executed at it
+};
+
+#ifndef MATCHINGENGINE_ORDER_CAPACITY
+#define MATCHINGENGINE_ORDER_CAPACITY (1 << 16)
+#endif
+
+struct OrderBook
+{
+    //public methods
+    //processNewBuyOrder
+    //processNewSelOrder
+    //processCancel
+    //processMod
+    //printBook
+    //endSession
+    //startAuction/uncross
+    //prefetchFinder/prefetchOrder/prefetchLevel (batch lookahead)
+    //snapshot
+    //memory
+    //setMarketDataSink/publishLevelChanges
+    //forEachRestingOrder/restoreOrder (snapshots)
+    //ctors/assg/dtor w/ object semantics
+
+    //processing a new order involves trying to match it against the current book
+    //and then giving it an order finder and sticking it in the book if
+    //there's anything left after the attempt to match
+    //book orders and their find information are removed if they are fully matched
+    //during the match process
+
+    //cancelling causes no match, so we just retreive the order and throw it away
+    //modifies, b/c they can switch sides and match, are done as a cancel, but then
+    //we alter the retrieve order, and push it back into processNew...
+    //except a size-down at the same side and price, which can't match anything:
+    //that is amended where it rests and keeps its place in the queue
+
+    //resting orders live in a slab pool owned by the book; a finder is the order's
+    //pool index, and the order's side and price lead back to its level; released
+    //slots are reused before the pool grows, so steady flow never touches the heap
+
+    //trades and printed levels go out as events to an ExecutionReportSink, which
+    //the book doesn't own; formatting and flushing are the sink's business
+
+    //with a MarketDataSink set, every level about to change is noted, and
+    //publishLevelChanges() sends L2 deltas for just those levels (see marketdata.h)
+
+    //with MATCHINGENGINE_STATS defined the hot paths also feed stats(): levels walked
+    //per sweep, orders touched per level, retrieve cost and level churn
+
+    //order ids are interned into dense handles (orderIds()) before they reach the
+    //book, and finders are kept in a flat hash index keyed by handle; the id text
+    //is only looked at again when a trade is printed
+
+    //every resting order is GFD, so at the close they all expire together:
+    //endSession() resets the pool and the finder index instead of removing orders
+    //one by one; a ladder side only wipes its occupancy bits, and a map side hands
+    //its nodes back to its recycler in one step, so rolling over costs the same
+    //however many levels and orders were resting (L2 gets one Clear per side, and
+    //the stats count the levels gone without visiting them); the session's order
+    //ids go too, and the next session reuses the same memory from the start
+
+    //startAuction() begins a collection phase: new orders (and modifies) rest
+    //without matching, IOCs lapse, and the book may cross; uncross() then clears
+    //everything that crosses at the one price that executes the most volume,
+    //buys and sells each filled in price-time priority, and matching goes back
+    //to continuous
+
+    //memory() reports every structure's footprint, retained against live: the order
+    //pool and index keep their high-water capacity, and map level nodes are reused
+    //within a session and kept over END_OF_DAY up to MATCHINGENGINE_RETAINED_LEVELS
+    //a side (see noderecycler.h)
+
+    //the book sides are chosen at compile time: the default keeps a std::map per side,
+    //building with MATCHINGENGINE_LADDER_BOOK defined (make BOOK=ladder) switches to a
+    //tick-indexed array over a PriceBand, with out-of-band prices kept sparse
+
+    using price_t          = ::price_t;
+    using order_queue_t    = OrderQueue;
+    using order_id_t       = order_handle_t;
+
+#ifdef MATCHINGENGINE_LADDER_BOOK
+    using bid_book_t       = LadderBookSide<order_queue_t, std::greater<price_t>>;
+    using ask_book_t       = LadderBookSide<order_queue_t, std::less<price_t>>;
+#else
+    using bid_book_t       = MapBookSide<order_queue_t, std::greater<price_t>>;
+    using ask_book_t       = MapBookSide<order_queue_t, std::less<price_t>>;
+#endif
+    using order_finder_t   = pool_index_t;
+    using order_map_t      = OrderIndex<order_finder_t>;
+
+    void processNewBuyOrder(Order newOrder)
+    {
+        if (!mCollecting) tryMatchOrder(newOrder, mAsks);
+        if (newOrder.TIF==TimeInForce::GFD && newOrder.Quantity > 0)
+        {
+            restOrder(newOrder, mBids);
+        }
+        //checkFullFinderConsistency(); ok
+        //checkForZeroSizeOrders(); ok
+    }
+    void processNewSelOrder(Order newOrder)
+    {
+        if (!mCollecting) tryMatchOrder(newOrder, mBids);
+        if (newOrder.TIF==TimeInForce::GFD && newOrder.Quantity > 0)
+        {
+            restOrder(newOrder, mAsks);
+        }
+        //checkFullFinderConsistency(); ok
+        //checkForZeroSizeOrders(); ok
+    }
+    void processCancel(order_id_t orderID)
+    {//will create no matches; all we have to do is remove it
+        auto order = order_finder_t();
+        if (!mOrderFinders.take(orderID, order)) return; //we don't know this order
+        mOrders.release(retrieveOrder(order));
+        //checkFullFinderConsistency(); ok
+    }
+    void processMod(order_id_t orderID, OrderSide side, price_t price, uint64_t quantity)
+    {//retrieve it (which removes it), modify its info, and process as if a new order;
+        //a size-down in place skips all of that (a size of 0 still removes it)
+        auto const finder = mOrderFinders.find(orderID);
+        if (!finder) return; //we don't know this order
+        auto const index = *finder;
+        auto const & resting = mOrders[index];
+        if (resting.Side==side && resting.Price==price && quantity != 0 && quantity <= resting.Quantity)
+        {
+            if (side==OrderSide::Buy) reduceOrder(index, resting.Quantity - quantity, mBids);
+            else                      reduceOrder(index, resting.Quantity - quantity, mAsks);
+            MATCHINGENGINE_STAT(++mStats.ModifiesInPlace);
+            return;
+        }
+        MATCHINGENGINE_STAT(++mStats.ModifiesReplaced);
+        mOrderFinders.erase(orderID);
+        //no longer there; copy it out and hand the slot back, if it rests again
+        //it will most likely get the same slot
+        auto order = mOrders[retrieveOrder(index)];
+        mOrders.release(index);
+
+        //alter this order for resubmission
+        order.Side     = side;
+        order.Price    = price;
+        order.Quantity = quantity;
+        //GFD stays the same and b/c id is the same, find info will be recreated appropriately
+        if (order.Side==OrderSide::Buy) processNewBuyOrder(order);
+        else                            processNewSelOrder(order);
+    }
+    //lookahead for a batch of commands (see MatchingEngine::processBatch), in three
+    //steps taken a few commands apart, each reading only what the step before
+    //brought into cache: the finder's home slot, then the finder itself, which
+    //gives the resting order's pool index, then that order's level, found from the
+    //index the second step handed back rather than by probing again; new orders
+    //just have their level fetched
+    void prefetchFinder(Command const & command) const
+    {
+        if (findsRestingOrder(command)) mOrderFinders.prefetch(command.OrderHandle);
+    }
+    pool_index_t prefetchOrder(Command const & command) const
+    {//the resting order's pool index, to hand to prefetchLevel; NoPoolIndex if there's none
+        if (!findsRestingOrder(command)) return NoPoolIndex;
+        auto const finder = mOrderFinders.find(command.OrderHandle);
+        if (!finder) return NoPoolIndex;
+        mOrders.prefetch(*finder);
+        return *finder;
+    }
+    void prefetchLevel(Command const & command, pool_index_t order) const
+    {//order is what prefetchOrder gave for command; the commands run since may have
+        //released it, or handed its slot to another order, which only misdirects the hint
+        if (order != NoPoolIndex)
+        {
+            auto const & resting = mOrders[order];
+            if (resting.Side==OrderSide::Buy) mBids.prefetchLevel(resting.Price);
+            else                              mAsks.prefetchLevel(resting.Price);
+        }
+        else if (command.Type==CommandType::Buy)  mBids.prefetchLevel(command.Price);
+        else if (command.Type==CommandType::Sell) mAsks.prefetchLevel(command.Price);
+    }
+    SessionStats endSession()
+    {//END_OF_DAY: the book is empty afterwards, and its order ids are forgotten, so
+        //the next session's handles start from 0 again (a journal replays the same)
+        MATCHINGENGINE_STAT(mStats.levelsErased(mBids.levels() + mAsks.levels()));
+        if (mMarketData) mLevelChanges.clear();
+        auto const stats = SessionStats{mSession++, mOrders.stats(), mOrderFinders.slots()};
+        mBids.clear();
+        mAsks.clear();
+        mOrderFinders.clear();
+        mOrders.reset();
+        mOrderIds.clear();
+        mCollecting = false;
+        return stats;
+    }
+    void startAuction() {mCollecting = true;}
+    bool collecting() const {return mCollecting;}
+    bool resting(order_id_t orderID) const {return mOrderFinders.find(orderID) != nullptr;}
+    AuctionResult uncross()
+    {//UNCROSS: the front orders of the best bid and ask levels trade at the clearing
+        //price until its volume is done; those are bids at or above it and asks at or
+        //below it, in priority order, and what's left of the book doesn't cross
+        mCollecting = false;
+        auto const result = clearingPrice();
+        auto remaining    = result.Volume;
+        while (remaining > 0)
+        {
+            auto & bidLevel = *mBids.bestLevel();
+            auto & askLevel = *mAsks.bestLevel();
+            touchLevel(OrderSide::Buy,  mBids.bestPrice(), bidLevel);
+            touchLevel(OrderSide::Sell, mAsks.bestPrice(), askLevel);
+            auto const bid       = bidLevel.front();
+            auto const ask       = askLevel.front();
+            auto const matchSize = std::min(std::min(mOrders[bid].Quantity, mOrders[ask].Quantity), remaining);
+            mReports->trade(TradeEvent{mOrders[bid].ID, mOrders[ask].ID, result.Price, result.Price, matchSize}, mOrderIds);
+            remaining -= matchSize;
+            fillFront(bid, matchSize, mBids);
+            fillFront(ask, matchSize, mAsks);
+        }
+        return result;
+    }
+    void printBook() const
+    {//both are to be descending, so the loop specification is different
+        auto const printLevel = [this](price_t price, order_queue_t const & level){this->printLevel(price, level);};
+        mReports->bookSide(OrderSide::Sell);
+        mAsks.forEachLevelReverse(printLevel);
+        mReports->bookSide(OrderSide::Buy);
+        mBids.forEachLevel(printLevel);
+    }
+
+    std::size_t snapshot(OrderSide side, LevelSnapshot * levels, std::size_t depth) const
+    {//the best depth levels of one side, best first, into the caller's levels; returns
+        //how many were written; costs O(depth), as each level carries its own totals
+        if (depth==0) return 0;
+        return (side==OrderSide::Buy) ? snapshotSide(mBids, levels, depth) : snapshotSide(mAsks, levels, depth);
+    }
+
+    void setMarketDataSink(MarketDataSink * marketData)
+    {//nullptr stops tracking; changes noted so far are dropped
+        mMarketData = marketData;
+        if (!mMarketData) mLevelChanges = LevelChangeTracker();
+    }
+    void publishLevelChanges()
+    {
+        if (!mMarketData) return;
+        mLevelChanges.publish(*mMarketData, [this](OrderSide side, price_t price) -> order_queue_t const *
+        {
+            return (side==OrderSide::Buy) ? mBids.findLevel(price) : mAsks.findLevel(price);
+        });
+    }
+
+    template <typename Fn>
+    void forEachRestingOrder(Fn && fn) const
+    {//fn(order): bids best to worst, then asks, each level in time priority; restoring
+        //them in this order with restoreOrder rebuilds the same book
+        auto const eachOrder = [this, &fn](price_t, order_queue_t const & level)
+        {
+            level.forEach(mOrders, [&fn](pool_index_t, Order const & order){fn(order);});
+        };
+        mBids.forEachLevel(eachOrder);
+        mAsks.forEachLevel(eachOrder);
+    }
+    void restoreOrder(Order const & order)
+    {//rests it at the back of its level without matching; only for rebuilding a book
+        //that wasn't crossed
+        if (order.Side==OrderSide::Buy) restOrder(order, mBids);
+        else                            restOrder(order, mAsks);
+    }
+    void setReportSink(ExecutionReportSink & reports) {mReports = &reports;}
+
+    OrderIdTable       & orderIds()       {return mOrderIds;}
+    OrderIdTable const & orderIds() const {return mOrderIds;}
+    PoolStats orderPoolStats()      const {return mOrders.stats();}
+    MemoryReport memory()           const
+    {
+        return MemoryReport{mOrders.stats(), mOrderFinders.bytes(), mOrderIds.bytes(), mBids.memory(), mAsks.memory()};
+    }
+#ifdef MATCHINGENGINE_STATS
+    BookStats const & stats()       const {return mStats;}
+#endif
+
+    //default object semantics; reports must outlive the book, the band only matters
+    //to ladder book sides, and orderCapacity is how many resting orders fit before
+    //the pool has to grow
+    explicit OrderBook(ExecutionReportSink & reports, PriceBand band = defaultPriceBand(),
+                       std::size_t orderCapacity = MATCHINGENGINE_ORDER_CAPACITY)
+    :mBids(band), mAsks(band), mOrderFinders(), mOrderIds(), mOrders(orderCapacity), mReports(&reports),
+    mMarketData(nullptr), mLevelChanges(), mSession(0), mCollecting(false), mBidDepth(), mAskDepth(), mAuctionPrices(){}
+    DEFAULT_OBJECT_SEMANTICS(OrderBook)
+    ~OrderBook(){}
+
+private:
+    struct DepthPoint
+    {
+        price_t  Price;
+        uint64_t Quantity; //at this level and every better one
+    };
+    struct AuctionPrice
+    {
+        price_t  Price;
+        uint64_t Bought; //bid at or above Price
+        uint64_t Sold;   //offered at or below it
+    };
+
+    static bool findsRestingOrder(Command const & command)
+    {
+        return command.Type==CommandType::Cancel || command.Type==CommandType::Modify;
+    }
+    template <typename BookType>
+    void restOrder(Order const & order, BookType & bookSide)
+    {
+        auto const index = mOrders.allocate();
+        mOrders[index]   = order;
+        mOrderFinders.insert(order.ID, index);
+        auto & level = bookSide.levelAt(order.Price);
+        MATCHINGENGINE_STAT(if (level.empty()) mStats.levelCreated());
+        touchLevel(order.Side, order.Price, level);
+        level.push_back(mOrders, index);
+    }
+    pool_index_t retrieveOrder(pool_index_t index)
+    {//unlinks the order from its level, dropping the level if that empties it;
+        //the caller releases the slot afterwards
+        if (mOrders[index].Side==OrderSide::Buy) retrieveOrderFromSide(index, mBids);
+        else                                     retrieveOrderFromSide(index, mAsks);
+        return index;
+    }
+    template <typename BookType>
+    void retrieveOrderFromSide(pool_index_t index, BookType & bookSide)
+    {
+        auto const priceLevel = mOrders[index].Price;
+        auto & levelOrders    = *bookSide.findLevel(priceLevel);
+        touchLevel(mOrders[index].Side, priceLevel, levelOrders);
+        retrieveOrderInLevelOrders(levelOrders, index);
+        if (levelOrders.empty())
+        {
+            bookSide.eraseLevel(priceLevel);
+            MATCHINGENGINE_STAT(mStats.levelErased());
+        }
+    }
+    template <typename BookType>
+    void reduceOrder(pool_index_t index, uint64_t quantity, BookType & bookSide)
+    {//shrinks a resting order by quantity without moving it; it stays non-empty
+        auto & order = mOrders[index];
+        auto & level = *bookSide.findLevel(order.Price);
+        touchLevel(order.Side, order.Price, level);
+        order.Quantity -= quantity;
+        level.reduce(quantity);
+    }
+    void retrieveOrderInLevelOrders(order_queue_t & levelOrders, pool_index_t index)
+    {//we only call this when we "know it's there"
+        MATCHINGENGINE_STAT(auto const start = readTicks());
+        levelOrders.unlink(mOrders, index);
+        MATCHINGENGINE_STAT(mStats.RetrieveTicks.record(readTicks() - start));
+    }
+    template <typename BookType>
+    void tryMatchOrder(Order & newOrder, BookType & bookSide)
+    {//levels come best first, so the first one that doesn't cross ends the sweep
+        auto newOrderWillMatchBook = (newOrder.Side==OrderSide::Buy) ? //side-dependent comparison
+        [](uint64_t n, uint64_t b){return (n >= b);} :
+        [](uint64_t n, uint64_t b){return (n <= b);} ;
+        auto const bookSideName = (newOrder.Side==OrderSide::Buy) ? OrderSide::Sell : OrderSide::Buy;
+        MATCHINGENGINE_STAT(auto levelsWalked = uint64_t(0));
+        while (newOrder.Quantity > 0 && !bookSide.empty())
+        {
+            auto const levelPrice = bookSide.bestPrice();
+            if (!newOrderWillMatchBook(newOrder.Price, levelPrice)) break;
+            auto & level = *bookSide.bestLevel();
+            touchLevel(bookSideName, levelPrice, level);
+            matchOrder(newOrder, level);
+            MATCHINGENGINE_STAT(++levelsWalked);
+            if (level.empty())
+            {
+                bookSide.eraseLevel(levelPrice);
+                MATCHINGENGINE_STAT(mStats.levelErased());
+            }
+        }
+        MATCHINGENGINE_STAT(mStats.LevelsWalked.record(levelsWalked));
+    }
+    void matchOrder(Order & newOrder, order_queue_t & bookLevel)
+    {//orders are in time order at a price, and we know the prices cross
+        //so we can just have at it, unlinking fully matched orders off the front
+        MATCHINGENGINE_STAT(auto ordersTouched = uint64_t(0));
+        while (!bookLevel.empty())
+        {
+            MATCHINGENGINE_STAT(++ordersTouched);
+            auto const index     = bookLevel.front();
+            auto & bookOrder     = mOrders[index];
+            auto const matchSize = (bookOrder.Quantity >= newOrder.Quantity ) ?
+            (newOrder.Quantity) : (bookOrder.Quantity) ;
+            printMatch(bookOrder, newOrder, matchSize);
+            newOrder.Quantity  -= matchSize;
+            bookOrder.Quantity -= matchSize;
+            bookLevel.reduce(matchSize);
+            if (bookOrder.Quantity==0)//we want to remove totally matched orders
+            {
+                mOrderFinders.erase(bookOrder.ID); //remove from finder book
+                bookLevel.unlink(mOrders, index);
+                mOrders.release(index);
+            }
+            if (newOrder.Quantity == 0) break;
+        }
+        MATCHINGENGINE_STAT(mStats.OrdersTouched.record(ordersTouched));
+    }
+    AuctionResult clearingPrice()
+    {//every crossing level's price is a candidate; the one executing the most wins,
+        //then the one leaving the smallest imbalance, then the highest that leaves
+        //buyers over, and failing that the lowest
+        mBidDepth.clear();
+        mAskDepth.clear();
+        mAuctionPrices.clear();
+        if (mBids.empty() || mAsks.empty() || mBids.bestPrice() < mAsks.bestPrice()) return AuctionResult{0, 0};
+        auto const lowest  = mAsks.bestPrice();
+        auto const highest = mBids.bestPrice();
+        accumulateDepth(mBids, mBidDepth, [lowest](price_t price){return price >= lowest;});
+        accumulateDepth(mAsks, mAskDepth, [highest](price_t price){return price <= highest;});
+
+        //candidates highest first, so bids at or above one only grow, and asks at or
+        //below it only shrink, as it goes
+        auto bid = std::size_t(0);
+        auto ask = mAskDepth.size();
+        while (bid < mBidDepth.size() || ask > 0)
+        {
+            auto price = price_t(0);
+            if (bid < mBidDepth.size()) price = mBidDepth[bid].Price;
+            if (ask > 0)                price = std::max(price, mAskDepth[ask - 1].Price);
+            while (bid < mBidDepth.size() && mBidDepth[bid].Price >= price) ++bid;
+            auto const bought = bid ? mBidDepth[bid - 1].Quantity : uint64_t(0);
+            auto const sold   = ask ? mAskDepth[ask - 1].Quantity : uint64_t(0);
+            mAuctionPrices.push_back(AuctionPrice{price, bought, sold});
+            while (ask > 0 && mAskDepth[ask - 1].Price >= price) --ask;
+        }
+        auto best = std::size_t(0);
+        for (auto i = std::size_t(1); i < mAuctionPrices.size(); ++i)
+        {
+            if (betterClearingPrice(mAuctionPrices[i], mAuctionPrices[best])) best = i;
+        }
+        auto const & chosen = mAuctionPrices[best];
+        return AuctionResult{chosen.Price, std::min(chosen.Bought, chosen.Sold)};
+    }
+    static bool betterClearingPrice(AuctionPrice const & lower, AuctionPrice const & higher)
+    {
+        auto const volume    = [](AuctionPrice const & p){return std::min(p.Bought, p.Sold);};
+        auto const imbalance = [](AuctionPrice const & p){return std::max(p.Bought, p.Sold) - std::min(p.Bought, p.Sold);};
+        if (volume(lower)    != volume(higher))    return volume(lower) > volume(higher);
+        if (imbalance(lower) != imbalance(higher)) return imbalance(lower) < imbalance(higher);
+        return higher.Bought <= higher.Sold;
+    }
+    template <typename BookType, typename Crosses>
+    void accumulateDepth(BookType const & bookSide, std::vector<DepthPoint> & depth, Crosses crosses)
+    {//the crossing levels, best first, each with the quantity at it and every better level
+        auto total = uint64_t(0);
+        bookSide.forEachLevelWhile([&depth, &total, crosses](price_t price, order_queue_t const & level)
+        {
+            if (!crosses(price)) return false;
+            total += level.quantity();
+            depth.push_back(DepthPoint{price, total});
+            return true;
+        });
+    }
+    template <typename BookType>
+    void fillFront(pool_index_t index, uint64_t quantity, BookType & bookSide)
+    {//some or all of the order at the front of bookSide's best level
+        auto & order = mOrders[index];
+        auto & level = *bookSide.bestLevel();
+        order.Quantity -= quantity;
+        level.reduce(quantity);
+        if (order.Quantity==0)
+        {
+            mOrderFinders.erase(order.ID);
+            level.unlink(mOrders, index);
+            mOrders.release(index);
+        }
+        if (level.empty())
+        {
+            bookSide.eraseLevel(bookSide.bestPrice());
+            MATCHINGENGINE_STAT(mStats.levelErased());
+        }
+    }
+    void touchLevel(OrderSide side, price_t price, order_queue_t const & level)
+    {
+        if (mMarketData) mLevelChanges.touch(side, price, level);
+    }
+    void printMatch(Order const & bookOrder, Order const & newOrder, uint64_t const matchSize) const
+    {//we know book order came first
+        mReports->trade(TradeEvent{bookOrder.ID, newOrder.ID, bookOrder.Price, newOrder.Price, matchSize}, mOrderIds);
+    }
+    void printLevel(price_t price, order_queue_t const & priceLevel) const
+    {
+        mReports->bookLevel(price, priceLevel.quantity());
+    }
+    template <typename BookType>
+    std::size_t snapshotSide(BookType const & bookSide, LevelSnapshot * levels, std::size_t depth) const
+    {
+        auto count = std::size_t(0);
+        bookSide.forEachLevelWhile([levels, depth, &count](price_t price, order_queue_t const & level)
+        {
+            levels[count++] = LevelSnapshot{price, level.quantity(), level.size()};
+            return count < depth;
+        });
+        return count;
+    }
+
+    //debugging methods
+    void checkForCrossedBook() const
+    {
+        if (mBids.empty() || mAsks.empty()) return;
+        auto const bestBid = mBids.bestPrice();
+        auto const bestAsk = mAsks.bestPrice();
+        if (bestAsk <= bestBid) throw;
+    }
+    void checkForFindersConsistency() const
+    {//every finder leads to an order that is linked into the level it claims
+        mOrderFinders.forEach([this](order_id_t orderID, order_finder_t index)
+        {
+            auto const & order = mOrders[index];
+            if (order.ID != orderID) throw;
+            auto const level = (order.Side==OrderSide::Buy) ? mBids.findLevel(order.Price) : mAsks.findLevel(order.Price);
+            if (!level) throw;
+            auto found = false;
+            level->forEach(mOrders, [index, &found](pool_index_t i, Order const &){if (i==index) found = true;});
+            if (!found) throw;
+        });
+    }
+    void checkFullFinderConsistency() const
+    {
+        //every order has a finder and it's got the right location
+        auto foundIDs = std::vector<order_id_t>();
+        checkBookAndAddIds(mBids, foundIDs);
+        checkBookAndAddIds(mAsks, foundIDs);
+        //and that's all the finders there are, and all the live orders in the pool
+        if (foundIDs.size() != mOrderFinders.size()) throw;
+        if (foundIDs.size() != mOrders.stats().Live) throw;
+    }
+    template <typename BookType>
+    void checkBookAndAddIds(BookType const & bookSide, std::vector<order_id_t> & foundIDs) const
+    {
+        bookSide.forEachLevel([this, &foundIDs](price_t price, order_queue_t const & level)
+        {
+            level.forEach(mOrders, [this, price, &foundIDs](pool_index_t index, Order const & o)
+            {
+                auto const finder = mOrderFinders.find(o.ID);
+                if (!finder) throw;
+                if (*finder != index || o.Price != price) throw;
+                foundIDs.push_back(o.ID);
+            });
+        });
+    }
+    void checkLevelTotals() const
+    {//the running totals match what summing the queue gives
+        auto const check = [this](price_t, order_queue_t const & level)
+        {
+            auto quantity = uint64_t(0);
+            auto orders   = uint64_t(0);
+            level.forEach(mOrders, [&quantity, &orders](pool_index_t, Order const & o){quantity += o.Quantity; ++orders;});
+            if (quantity != level.quantity() || orders != level.size()) throw;
+        };
+        mBids.forEachLevel(check);
+        mAsks.forEachLevel(check);
+    }
+    void checkForZeroSizeOrders() const
+    {
+        checkForZeroSize(mBids);
+        checkForZeroSize(mAsks);
+    }
+    template <typename BookType>
+    void checkForZeroSize(BookType const & bookSide) const
+    {
+        bookSide.forEachLevel([this](price_t, order_queue_t const & level)
+        {
+            level.forEach(mOrders, [](pool_index_t, Order const & o){if (o.Quantity==0) throw;});
+        });
+    }
+
+private:
+    bid_book_t            mBids;
+    ask_book_t            mAsks;
+    order_map_t           mOrderFinders;
+    OrderIdTable          mOrderIds;
+    order_pool_t          mOrders;
+    ExecutionReportSink * mReports;
+#ifdef MATCHINGENGINE_STATS
+    BookStats             mStats;
+#endif
+    MarketDataSink *      mMarketData;   //nullptr when nobody wants L2 deltas
+    LevelChangeTracker    mLevelChanges;
+    uint64_t              mSession;      //sessions ended so far
+    bool                  mCollecting;   //between startAuction() and uncross()
+
+    //uncross() scratch, kept so an auction only allocates while it outgrows the last
+    std::vector<DepthPoint>   mBidDepth;
+    std::vector<DepthPoint>   mAskDepth;
+    std::vector<AuctionPrice> mAuctionPrices; //candidates, highest first
+};
+
+#endif
@@ -0,0 +1,272 @@
+#ifndef MATCHINGENGINE_ORDERINDEX_H
+#define MATCHINGENGINE_ORDERINDEX_H
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "objectsemantics.h"
+#include "ordertypes.h"
+#include "messagereader.h"
+
+//both tables here are open-addressing with linear probing over a power-of-two
+//slot array: a probe is a short run of adjacent slots rather than a chain of
+//tree nodes, and they grow by doubling once half full
+
+struct OrderIdTable
+{//interns text order ids into dense handles, handed out in order of first
+    //appearance; ids are interned once at entry and only handles go further
+    //an id is held until clear(), which forgets them all and starts the handles
+    //from 0 again; nothing is forgotten before that, not even the ids of IOC or
+    //filled orders, so with the engine clearing at END_OF_DAY the table grows to
+    //every distinct id of the session, not just those resting at once
+    //
+    //once a session has interned limit ids, each new id is refused (intern gives
+    //NoOrderHandle, and the text decoder drops the order) until the next clear();
+    //ids already held still work, so a long session keeps trading its resting
+    //orders but takes no new ones, and the memory it held stays for the next
+    order_handle_t intern(Token const & orderID)
+    {//NoOrderHandle for a new id once the limit is held, never a handle past it
+        auto const hash = hashOf(orderID);
+        auto slot       = probe(orderID, hash);
+        if (mSlots[slot] != NoOrderHandle) return mSlots[slot];
+        if (mNames.size() >= mLimit) return NoOrderHandle;
+        if ((mNames.size() + 1)*2 > mSlots.size())
+        {
+            grow();
+            slot = probe(orderID, hash);
+        }
+        auto const handle = static_cast<order_handle_t>(mNames.size());
+        mNames.push_back(Name{mChars.size(), orderID.Size, hash});
+        mChars.insert(mChars.end(), orderID.Data, orderID.Data + orderID.Size);
+        mSlots[slot] = handle;
+        return handle;
+    }
+    bool restore(order_handle_t handle, Token const & orderID)
+    {//orderID at the handle a snapshot or journal recorded for it, where handles before
+        //it may go unheld; false if the id or the handle is already held otherwise
+        auto const hash = hashOf(orderID);
+        auto slot       = probe(orderID, hash);
+        if (mSlots[slot] != NoOrderHandle) return mSlots[slot]==handle;
+        if (contains(handle) || !advance(std::size_t(handle) + 1)) return false;
+        slot = probe(orderID, hash);
+        mNames[handle] = Name{mChars.size(), orderID.Size, hash};
+        mChars.insert(mChars.end(), orderID.Data, orderID.Data + orderID.Size);
+        mSlots[slot] = handle;
+        return true;
+    }
+    bool advance(std::size_t handles)
+    {//counts the first handles as handed out, held or not, so the next new id gets
+        //the one after; false past the limit
+        if (handles > mLimit) return false;
+        if (handles <= mNames.size()) return true;
+        mNames.resize(handles, Name{0, Unheld, 0});
+        while (mNames.size()*2 > mSlots.size()) grow();
+        return true;
+    }
+    order_handle_t find(Token const & orderID) const
+    {//NoOrderHandle if this id was never interned
+        return mSlots[probe(orderID, hashOf(orderID))];
+    }
+    bool  contains(order_handle_t handle) const {return handle < mNames.size() && mNames[handle].Size != Unheld;}
+    Token name(order_handle_t handle)     const
+    {//only valid until the next intern
+        auto const & n = mNames[handle];
+        return Token(mChars.data() + n.Offset, n.Size);
+    }
+    std::size_t size() const {return mNames.size();} //handles handed out, held or not
+    std::size_t bytes() const
+    {//capacity, not just what's used: the tables grow by doubling
+        return mSlots.capacity()*sizeof(order_handle_t) + mNames.capacity()*sizeof(Name) + mChars.capacity();
+    }
+    void clear()
+    {//every id forgotten, the memory kept for the next ones; a pass over the slots
+        std::fill(mSlots.begin(), mSlots.end(), NoOrderHandle);
+        mNames.clear();
+        mChars.clear();
+    }
+
+    //limit is how many ids can be interned between clear()s; NoOrderHandle is never
+    //a handle, so it is also the most there can be
+    explicit OrderIdTable(std::size_t limit = NoOrderHandle)
+    :mSlots(InitialSlots, NoOrderHandle), mNames(), mChars(), mLimit(limit < NoOrderHandle ? limit : NoOrderHandle){}
+    DEFAULT_OBJECT_SEMANTICS(OrderIdTable)
+    ~OrderIdTable(){}
+private:
+    static constexpr std::size_t InitialSlots = 1 << 10;
+    static constexpr std::size_t Unheld       = std::size_t(-1); //a Name's Size for a handle skipped by advance()
+
+    struct Name
+    {
+        std::size_t Offset;
+        std::size_t Size;
+        uint64_t    Hash;
+    };
+
+    static uint64_t hashOf(Token const & orderID)
+    {//FNV-1a
+        auto hash = uint64_t(14695981039346656037ull);
+        for (auto i = std::size_t(0); i < orderID.Size; ++i)
+        {
+            hash ^= static_cast<unsigned char>(orderID.Data[i]);
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+    std::size_t probe(Token const & orderID, uint64_t hash) const
+    {//the slot holding orderID, or the empty slot where it would go
+        auto const mask = mSlots.size() - 1;
+        for (auto slot = static_cast<std::size_t>(hash) & mask; ; slot = (slot + 1) & mask)
+        {
+            auto const handle = mSlots[slot];
+            if (handle==NoOrderHandle) return slot;
+            auto const & n = mNames[handle];
+            if (n.Hash==hash && n.Size==orderID.Size &&
+                std::memcmp(mChars.data() + n.Offset, orderID.Data, n.Size)==0) return slot;
+        }
+    }
+    void grow()
+    {
+        auto slots = std::vector<order_handle_t>(mSlots.size()*2, NoOrderHandle);
+        auto const mask = slots.size() - 1;
+        for (auto handle = order_handle_t(0); handle < mNames.size(); ++handle)
+        {
+            if (mNames[handle].Size==Unheld) continue;
+            auto slot = static_cast<std::size_t>(mNames[handle].Hash) & mask;
+            while (slots[slot] != NoOrderHandle) slot = (slot + 1) & mask;
+            slots[slot] = handle;
+        }
+        mSlots.swap(slots);
+    }
+
+    std::vector<order_handle_t> mSlots;
+    std::vector<Name>           mNames; //indexed by handle
+    std::vector<char>           mChars; //every interned id, back to back
+    std::size_t                 mLimit;
+};
+
+template <typename Value>
+struct OrderIndex
+{//handle -> Value for live orders; erase shifts later entries of the probe run
+    //back instead of leaving tombstones, so a cancel-heavy flow never degrades it
+    //a slot is only in use if it was filled this epoch, so clear() empties the
+    //whole table in O(1) by starting a new one, and keeps the slots for reuse
+    Value * find(order_handle_t handle)
+    {
+        auto const slot = probe(handle);
+        return used(slot) ? &mSlots[slot].Item : nullptr;
+    }
+    Value const * find(order_handle_t handle) const
+    {
+        return const_cast<OrderIndex *>(this)->find(handle);
+    }
+    void insert(order_handle_t handle, Value const & item)
+    {//overwrites an existing entry
+        auto slot = probe(handle);
+        if (!used(slot))
+        {
+            if ((mSize + 1)*2 > mSlots.size())
+            {
+                grow();
+                slot = probe(handle);
+            }
+            ++mSize;
+        }
+        mSlots[slot] = Slot{handle, mEpoch, item};
+    }
+    bool take(order_handle_t handle, Value & item)
+    {//find and erase in one probe
+        auto const slot = probe(handle);
+        if (!used(slot)) return false;
+        item = mSlots[slot].Item;
+        eraseSlot(slot);
+        return true;
+    }
+    bool erase(order_handle_t handle)
+    {
+        auto const slot = probe(handle);
+        if (!used(slot)) return false;
+        eraseSlot(slot);
+        return true;
+    }
+    void prefetch(order_handle_t handle) const {__builtin_prefetch(&mSlots[home(handle)]);} //where a probe for it starts
+    template <typename Fn>
+    void forEach(Fn && fn) const
+    {
+        for (auto const & s : mSlots) if (s.Epoch==mEpoch) fn(s.Handle, s.Item);
+    }
+    std::size_t size()  const {return mSize;}
+    std::size_t slots() const {return mSlots.size();}
+    std::size_t bytes() const {return mSlots.capacity()*sizeof(Slot);}
+    void clear()
+    {//every entry gone at once; only a wrapped epoch costs a pass over the slots
+        mSize = 0;
+        if (++mEpoch != FreeEpoch) return;
+        for (auto & s : mSlots) s.Epoch = FreeEpoch;
+        mEpoch = FreeEpoch + 1;
+    }
+
+    OrderIndex():mSlots(InitialSlots, Slot{NoOrderHandle, FreeEpoch, Value()}), mSize(0), mEpoch(FreeEpoch + 1){}
+    DEFAULT_OBJECT_SEMANTICS(OrderIndex)
+    ~OrderIndex(){}
+private:
+    static constexpr std::size_t InitialSlots = 1 << 10;
+    static constexpr uint32_t    FreeEpoch    = 0; //no epoch is ever this, so erased slots are marked with it
+
+    struct Slot
+    {
+        order_handle_t Handle;
+        uint32_t       Epoch; //in use only if this is the table's current epoch
+        Value          Item;
+    };
+
+    bool used(std::size_t slot) const {return mSlots[slot].Epoch==mEpoch;}
+
+    std::size_t home(order_handle_t handle) const
+    {//handles are dense, so scramble them (Fibonacci hashing) before masking
+        return static_cast<std::size_t>((uint64_t(handle)*11400714819323198485ull) >> 32) & (mSlots.size() - 1);
+    }
+    std::size_t probe(order_handle_t handle) const
+    {
+        auto const mask = mSlots.size() - 1;
+        auto slot       = home(handle);
+        while (used(slot) && mSlots[slot].Handle != handle) slot = (slot + 1) & mask;
+        return slot;
+    }
+    void eraseSlot(std::size_t hole)
+    {//backward-shift deletion: pull up any later entry whose home doesn't lie
+        //cyclically in (hole, slot], so every remaining entry stays reachable
+        auto const mask = mSlots.size() - 1;
+        for (auto slot = (hole + 1) & mask; used(slot); slot = (slot + 1) & mask)
+        {
+            auto const h = home(mSlots[slot].Handle);
+            auto const reachable = (hole <= slot) ? (hole < h && h <= slot) : (hole < h || h <= slot);
+            if (reachable) continue;
+            mSlots[hole] = mSlots[slot];
+            hole = slot;
+        }
+        mSlots[hole].Epoch = FreeEpoch;
+        --mSize;
+    }
+    void grow()
+    {
+        auto slots = std::vector<Slot>(mSlots.size()*2, Slot{NoOrderHandle, FreeEpoch, Value()});
+        slots.swap(mSlots);
+        auto const mask = mSlots.size() - 1;
+        for (auto const & s : slots)
+        {
+            if (s.Epoch != mEpoch) continue;
+            auto slot = home(s.Handle);
+            while (used(slot)) slot = (slot + 1) & mask;
+            mSlots[slot] = s;
+        }
+    }
+
+    std::vector<Slot> mSlots;
+    std::size_t       mSize;
+    uint32_t          mEpoch;
+};
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef MATCHINGENGINE_ORDERTYPES_H
+#define MATCHINGENGINE_ORDERTYPES_H
+
+#include <cstdint>
+
+//vocabulary shared by the protocols, the book and its indexes
+
+using price_t        = uint64_t;
+using order_handle_t = uint32_t; //dense, interned stand-in for an order id
+
+constexpr order_handle_t NoOrderHandle = order_handle_t(-1);
+
+enum class OrderSide   : uint8_t {Buy = 0, Sell = 1};
+enum class TimeInForce : uint8_t {GFD = 0, IOC = 1};
+
+#endif
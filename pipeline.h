@@ -0,0 +1,319 @@
+#ifndef MATCHINGENGINE_PIPELINE_H
+#define MATCHINGENGINE_PIPELINE_H
+
+#include <thread>
+#include <vector>
+#include <deque>
+#include <cstdint>
+
+#include "messagereader.h"
+#include "binaryprotocol.h"
+#include "textprotocol.h"
+#include "reportsink.h"
+#include "orderindex.h"
+#include "matchingengine.h"
+#include "spscring.h"
+
+//one book in three stages, each on its own thread and each fed by a preallocated
+//SpscRing:
+//
+//  parser (the caller's thread)  reads and decodes messages into Commands, and
+//                                interns text ids
+//  matcher                       runs the MatchingEngine on Commands alone; its
+//                                reports become events on the next ring
+//  output                        hands those events to the real ExecutionReportSink
+//
+//every message goes through every stage in order, so what the sink sees, and
+//when, is exactly what the sequential engine would have given it. The parser's
+//id names reach the output stage on a ring of their own, and each event says how
+//many names must have arrived before it can be formatted; ids last a session, as
+//in the engine, so an END_OF_DAY is followed on that ring by a marker that starts
+//the output stage's next session's names
+
+struct PipelineConfig
+{
+    std::size_t RingSlots; //per ring
+    std::size_t Batch;     //slots a stage fills (or empties) before making them visible; 1 for interactive input
+    PriceBand   Band;      //the book's ladder band
+};
+
+inline PipelineConfig defaultPipelineConfig() {return PipelineConfig{1 << 14, 64, defaultPriceBand()};}
+
+struct PipelineCommand
+{
+    Command  Message;
+    uint32_t Session; //END_OF_DAYs the parser had sent before this
+    uint32_t Names;   //ids the parser had interned this session by the time it sent this
+    bool     Last;    //no more after this; Message is unused
+};
+
+struct PipelineEvent
+{//one call the matcher made on its report sink
+    enum class Kind : uint8_t {Trade, BookSide, BookLevel, EndOfMessage, Last};
+
+    Kind       Type;
+    OrderSide  Side;   //BookSide
+    uint32_t   Session; //as PipelineCommand's, for the message that caused it
+    uint32_t   Names;
+    TradeEvent Trade;  //Trade; BookLevel uses BookPrice and Quantity
+};
+
+struct PipelineReportSink : ExecutionReportSink
+{//the matcher's sink: every report becomes an event, staged and made visible a batch
+    //at a time, or as soon as the matcher runs out of work
+    void trade(TradeEvent const & trade, OrderIdTable const &) override
+    {
+        auto & event = next(PipelineEvent::Kind::Trade);
+        event.Trade  = trade;
+        stage();
+    }
+    void bookSide(OrderSide side) override
+    {
+        auto & event = next(PipelineEvent::Kind::BookSide);
+        event.Side   = side;
+        stage();
+    }
+    void bookLevel(price_t price, uint64_t quantity) override
+    {
+        auto & event          = next(PipelineEvent::Kind::BookLevel);
+        event.Trade.BookPrice = price;
+        event.Trade.Quantity  = quantity;
+        stage();
+    }
+    void endOfMessage() override
+    {
+        next(PipelineEvent::Kind::EndOfMessage);
+        stage();
+    }
+    void flush() override
+    {
+        mEvents->flush();
+        mStaged = 0;
+    }
+    void last()
+    {
+        next(PipelineEvent::Kind::Last);
+        stage();
+        flush();
+    }
+    void setNames(uint32_t session, uint32_t names)
+    {
+        mSession = session;
+        mNames   = names;
+    }
+
+    PipelineReportSink(SpscRing<PipelineEvent> & events, std::size_t batch)
+    :mEvents(&events), mBatch(batch ? batch : 1), mStaged(0), mSession(0), mNames(0){}
+    PipelineReportSink(PipelineReportSink const &)             = delete;
+    PipelineReportSink & operator=(PipelineReportSink const &) = delete;
+    ~PipelineReportSink(){}
+private:
+    PipelineEvent & next(PipelineEvent::Kind type)
+    {
+        auto & event = mEvents->claimWait();
+        event.Type    = type;
+        event.Session = mSession;
+        event.Names   = mNames;
+        return event;
+    }
+    void stage()
+    {
+        mEvents->stage();
+        if (++mStaged >= mBatch) flush();
+    }
+
+    SpscRing<PipelineEvent> * mEvents;
+    std::size_t               mBatch;
+    std::size_t               mStaged;
+    uint32_t                  mSession;
+    uint32_t                  mNames;
+};
+
+struct PipelinedEngine
+{
+    template <typename TextReader>
+    void processMessages(TextReader & reader)
+    {//as MatchingEngine's
+        auto message = Token();
+        while (reader.nextMessage(message))
+        {
+            mTokens.tokenize(message.Data, message.Size);
+            auto const known   = mOrderIds.size();
+            auto const command = decodeTextMessage(mTokens, mOrderIds);
+            if (mOrderIds.size() != known)
+            {
+                auto const name = mOrderIds.name(command.OrderHandle);
+                sendText(mNames, command.OrderHandle, name.Data, name.Size);
+            }
+            send(command);
+            if (command.Type==CommandType::EndOfDay) endSession();
+        }
+        mCommands.flush();
+    }
+    void processMessages(BinaryMessageReader & reader)
+    {//binary ids are handles already, and have no names to pass on
+        auto record = static_cast<unsigned char const *>(nullptr);
+        while (reader.nextRecord(record)) send(BinaryCodec::decode(record));
+        mCommands.flush();
+    }
+    void finish()
+    {//waits for every message to be matched and its reports handed to the sink
+        if (mFinished) return;
+        mFinished = true;
+        auto & slot = mCommands.claimWait();
+        slot.Last   = true;
+        mCommands.publish();
+        mMatcher.join();
+        mOutput.join();
+    }
+    //set the engine up (market data and so on) before the first message, and read
+    //it after finish(); in between it belongs to the matcher thread
+    MatchingEngine & engine() {return mEngine;}
+
+    //reports must outlive the pipeline, and is only called from the output thread
+    explicit PipelinedEngine(ExecutionReportSink & reports, PipelineConfig config = defaultPipelineConfig())
+    :mConfig(config), mCommands(config.RingSlots), mEvents(config.RingSlots), mNames(config.RingSlots),
+    mTokens(), mOrderIds(), mSession(0), mStaged(0), mMatcherSink(mEvents, config.Batch), mEngine(mMatcherSink, config.Band),
+    mReports(&reports), mOutputIds(1), mOutputSession(0), mNameScratch(), mMatcher(), mOutput(), mFinished(false)
+    {
+        if (mConfig.Batch==0) mConfig.Batch = 1;
+        mMatcher = std::thread([this]{runMatcher();});
+        mOutput  = std::thread([this]{runOutput();});
+    }
+    PipelinedEngine(PipelinedEngine const &)             = delete; //the threads hold on to it
+    PipelinedEngine & operator=(PipelinedEngine const &) = delete;
+    ~PipelinedEngine(){finish();}
+private:
+    void send(Command const & command)
+    {
+        auto & slot  = mCommands.claimWait();
+        slot.Message = command;
+        slot.Session = mSession;
+        slot.Names   = static_cast<uint32_t>(mOrderIds.size());
+        slot.Last    = false;
+        mCommands.stage();
+        if (++mStaged >= mConfig.Batch)
+        {
+            mCommands.flush();
+            mStaged = 0;
+        }
+    }
+    void endSession()
+    {//as the engine forgets its ids at END_OF_DAY, so does the parser, and the
+        //output stage once it reaches the marker
+        mOrderIds.clear();
+        ++mSession;
+        sendText(mNames, SessionMarker, nullptr, 0);
+    }
+    void runMatcher()
+    {
+        auto consumed = std::size_t(0);
+        for (;;)
+        {
+            auto slot = mCommands.front();
+            if (!slot)
+            {//caught up: let the output stage have what there is before waiting
+                mMatcherSink.flush();
+                slot = &mCommands.frontWait();
+            }
+            if (slot->Last) break;
+            mMatcherSink.setNames(slot->Session, slot->Names);
+            mEngine.processMessage(slot->Message);
+            mCommands.consume();
+            if (++consumed >= mConfig.Batch)
+            {
+                mCommands.release();
+                consumed = 0;
+            }
+        }
+        mCommands.pop();
+        mMatcherSink.last();
+    }
+    void runOutput()
+    {
+        auto consumed = std::size_t(0);
+        for (;;)
+        {
+            auto const & event    = nextEvent();
+            auto const & orderIds = namesFor(event);
+            switch (event.Type)
+            {
+                case PipelineEvent::Kind::Trade:        mReports->trade(event.Trade, orderIds); break;
+                case PipelineEvent::Kind::BookSide:     mReports->bookSide(event.Side); break;
+                case PipelineEvent::Kind::BookLevel:    mReports->bookLevel(event.Trade.BookPrice, event.Trade.Quantity); break;
+                case PipelineEvent::Kind::EndOfMessage: mReports->endOfMessage(); break;
+                case PipelineEvent::Kind::Last:
+                    mEvents.pop();
+                    return;
+            }
+            mEvents.consume();
+            if (++consumed >= mConfig.Batch)
+            {
+                mEvents.release();
+                consumed = 0;
+            }
+        }
+    }
+    PipelineEvent const & nextEvent()
+    {//names are taken early while waiting, as the parser may be held up sending
+        //them, with the commands that would produce these events still unsent
+        auto backoff = Backoff();
+        for (;;)
+        {
+            if (auto const event = mEvents.front()) return *event;
+            mEvents.release();
+            if (mNames.front()) receiveName();
+            else backoff.pause();
+        }
+    }
+    OrderIdTable const & namesFor(PipelineEvent const & event)
+    {//the ids of event's session, once as many have arrived as it needs; names may
+        //have been taken early, into sessions past it, but never one before it
+        while (mOutputSession < event.Session)
+        {
+            if (mOutputIds.size()==1)
+            {
+                receiveName(); //its session's marker, eventually
+                continue;
+            }
+            mOutputIds.pop_front();
+            ++mOutputSession;
+        }
+        while (mOutputIds.front().size() < event.Names) receiveName();
+        return mOutputIds.front();
+    }
+    void receiveName()
+    {//names come in handle order, so interning them again gives the parser's handles
+        auto const tag  = mNames.frontWait().Tag;
+        auto inPlace    = false;
+        auto const name = receiveText(mNames, mNames.frontWait(), mNameScratch, inPlace);
+        if (tag==SessionMarker) mOutputIds.emplace_back();
+        else                    mOutputIds.back().intern(name);
+        if (inPlace) mNames.pop();
+    }
+
+    static constexpr uint32_t SessionMarker = NoOrderHandle; //on the name ring, in place of a handle
+
+    PipelineConfig            mConfig;
+    SpscRing<PipelineCommand> mCommands; //parser to matcher
+    SpscRing<PipelineEvent>   mEvents;   //matcher to output
+    text_ring_t               mNames;    //parser to output
+    //parser
+    message_tokens_t          mTokens;
+    OrderIdTable              mOrderIds;
+    uint32_t                  mSession;
+    std::size_t               mStaged;
+    //matcher
+    PipelineReportSink        mMatcherSink;
+    MatchingEngine            mEngine;
+    //output
+    ExecutionReportSink *     mReports;
+    std::deque<OrderIdTable>  mOutputIds;     //a session's names each, from mOutputSession's on
+    uint32_t                  mOutputSession;
+    std::vector<char>         mNameScratch;
+    std::thread               mMatcher;
+    std::thread               mOutput;
+    bool                      mFinished;
+};
+
+#endif
@@ -0,0 +1,286 @@
+#ifndef MATCHINGENGINE_REFERENCEBOOK_H
+#define MATCHINGENGINE_REFERENCEBOOK_H
+
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <functional>
+#include <cstdint>
+
+#include "objectsemantics.h"
+
+//the book as the rules read, written for being obviously right rather than fast:
+//the original design (string ids and tokens, a std::map of vectors per side, a
+//std::map of finders), taught everything the engine has learnt since, so the
+//optimized book can be checked against it message by message (see replaydiff.cpp)
+//
+//a new order matches the best opposite levels while they cross, each at the book
+//order's price, and the rest of a GFD order rests at the back of its level; a
+//MODIFY is a cancel and a new order with the same id and TIF, except a size-down
+//at the same side and price, which keeps its place; END_OF_DAY empties the book;
+//between AUCTION and UNCROSS nothing matches, and the uncross fills everything
+//that crosses at the one price executing the most (see uncross); an order or
+//MODIFY whose price or quantity isn't a plain unsigned decimal is ignored
+//
+//reports are the text protocol's lines, written to the stream each call is given
+
+struct ReferenceOrder
+{
+    std::string Side;
+    std::string TimeInForce;
+    uint64_t    Price;
+    uint64_t    Quantity;
+    std::string ID;
+    uint64_t    Sequence; //arrival, so an order is found even among others with its id
+};
+
+struct ReferenceBook
+{
+    using price_t          = uint64_t;
+    using message_tokens_t = std::vector<std::string>;
+    using order_vector_t   = std::vector<ReferenceOrder>;
+    using bid_book_t       = std::map<price_t, order_vector_t, std::greater<price_t>>;
+    using ask_book_t       = std::map<price_t, order_vector_t>;
+
+    void processMessage(std::string const & message, std::ostream & reports)
+    {
+        auto const messageTokens = tokenizeMessage(message);
+        auto const & leadToken   = messageTokens.front();
+        if      (leadToken=="BUY" || leadToken=="SELL") processOrderMessage(messageTokens, reports);
+        else if (leadToken=="MODIFY")     processMod(messageTokens, reports);
+        else if (leadToken=="CANCEL")     processCancel(messageTokens.at(1));
+        else if (leadToken=="PRINT")      printBook(reports);
+        else if (leadToken=="END_OF_DAY") endSession();
+        else if (leadToken=="AUCTION")    mCollecting = true;
+        else if (leadToken=="UNCROSS")    uncross(reports);
+        //STATS, and anything unknown, changes nothing
+    }
+
+    ReferenceBook():mBids(), mAsks(), mOrderFinders(), mSequence(0), mCollecting(false){}
+    DEFAULT_OBJECT_SEMANTICS(ReferenceBook)
+    ~ReferenceBook(){}
+private:
+    struct Finder
+    {
+        std::string Side;
+        price_t     Price;
+        uint64_t    Sequence;
+    };
+    struct Candidate
+    {
+        price_t  Price;
+        uint64_t Bought; //bid at or above Price
+        uint64_t Sold;   //offered at or below it
+    };
+
+    static message_tokens_t tokenizeMessage(std::string const & message)
+    {
+        auto tokens     = message_tokens_t();
+        auto tokenStart = std::size_t(0);
+        for (auto i = std::size_t(0); i < message.size(); ++i)
+        {
+            if (message[i]==' ')
+            {
+                tokens.push_back(message.substr(tokenStart, i - tokenStart));
+                tokenStart = i + 1;
+            }
+        }
+        tokens.push_back(message.substr(tokenStart));
+        return tokens;
+    }
+    static bool toUnsigned(std::string const & token, uint64_t & value)
+    {//digits only, and the stream fails on overflow
+        return !token.empty() && token.find_first_not_of("0123456789")==std::string::npos && (std::stringstream(token) >> value);
+    }
+
+    void processOrderMessage(message_tokens_t const & messageTokens, std::ostream & reports)
+    {
+        auto price    = uint64_t(0);
+        auto quantity = uint64_t(0);
+        if (!toUnsigned(messageTokens.at(2), price) || !toUnsigned(messageTokens.at(3), quantity)) return;
+        processNewOrder(ReferenceOrder{messageTokens.at(0), messageTokens.at(1), price, quantity, messageTokens.at(4), mSequence++},
+                        reports);
+    }
+    void processNewOrder(ReferenceOrder order, std::ostream & reports)
+    {
+        if (!mCollecting)
+        {
+            if (order.Side=="BUY") matchOrder(order, mAsks, reports);
+            else                   matchOrder(order, mBids, reports);
+        }
+        if (order.TimeInForce != "GFD" || order.Quantity==0) return;
+        mOrderFinders[order.ID] = Finder{order.Side, order.Price, order.Sequence};
+        if (order.Side=="BUY") mBids[order.Price].push_back(order);
+        else                   mAsks[order.Price].push_back(order);
+    }
+    void processCancel(std::string const & orderID)
+    {
+        auto const finder = mOrderFinders.find(orderID);
+        if (finder==mOrderFinders.end()) return;
+        auto const where = finder->second;
+        mOrderFinders.erase(finder);
+        if (where.Side=="BUY") takeOrder(mBids, where);
+        else                   takeOrder(mAsks, where);
+    }
+    void processMod(message_tokens_t const & messageTokens, std::ostream & reports)
+    {
+        auto const finder = mOrderFinders.find(messageTokens.at(1));
+        if (finder==mOrderFinders.end()) return;
+        auto price    = uint64_t(0);
+        auto quantity = uint64_t(0);
+        if (!toUnsigned(messageTokens.at(3), price) || !toUnsigned(messageTokens.at(4), quantity)) return;
+        auto const where = finder->second;
+        auto const side  = std::string(messageTokens.at(2)=="BUY" ? "BUY" : "SELL");
+        auto & resting = (where.Side=="BUY") ? findOrder(mBids, where) : findOrder(mAsks, where);
+        if (side==where.Side && price==where.Price && quantity != 0 && quantity <= resting.Quantity)
+        {
+            resting.Quantity = quantity;
+            return;
+        }
+        mOrderFinders.erase(finder);
+        auto order = (where.Side=="BUY") ? takeOrder(mBids, where) : takeOrder(mAsks, where);
+        order.Side     = side;
+        order.Price    = price;
+        order.Quantity = quantity;
+        order.Sequence = mSequence++;
+        processNewOrder(order, reports);
+    }
+    template <typename BookType>
+    static ReferenceOrder & findOrder(BookType & bookSide, Finder const & where)
+    {
+        auto & level = bookSide.at(where.Price);
+        return *std::find_if(level.begin(), level.end(),
+                             [&where](ReferenceOrder const & o){return o.Sequence==where.Sequence;});
+    }
+    template <typename BookType>
+    static ReferenceOrder takeOrder(BookType & bookSide, Finder const & where)
+    {
+        auto & level = bookSide.at(where.Price);
+        auto const found = std::find_if(level.begin(), level.end(),
+                                        [&where](ReferenceOrder const & o){return o.Sequence==where.Sequence;});
+        auto const order = *found;
+        level.erase(found);
+        if (level.empty()) bookSide.erase(where.Price);
+        return order;
+    }
+    template <typename BookType>
+    void matchOrder(ReferenceOrder & order, BookType & bookSide, std::ostream & reports)
+    {//the first order of the best level, again and again
+        while (order.Quantity > 0 && !bookSide.empty())
+        {
+            auto const best = bookSide.begin();
+            if (order.Side=="BUY" ? order.Price < best->first : order.Price > best->first) break;
+            auto & bookOrder = best->second.front();
+            auto const quantity = std::min(bookOrder.Quantity, order.Quantity);
+            printTrade(bookOrder.ID, bookOrder.Price, order.ID, order.Price, quantity, reports);
+            order.Quantity     -= quantity;
+            bookOrder.Quantity -= quantity;
+            if (bookOrder.Quantity==0)
+            {
+                mOrderFinders.erase(bookOrder.ID);
+                best->second.erase(best->second.begin());
+                if (best->second.empty()) bookSide.erase(best);
+            }
+        }
+    }
+    void uncross(std::ostream & reports)
+    {//every price on the book is a candidate; the most volume wins, then the smallest
+        //imbalance, then the highest price that leaves buyers over, else the lowest
+        mCollecting = false;
+        auto candidates = std::vector<Candidate>();
+        for (auto const & level : mBids) candidates.push_back(candidate(level.first));
+        for (auto const & level : mAsks) candidates.push_back(candidate(level.first));
+        auto const volume    = [](Candidate const & c){return std::min(c.Bought, c.Sold);};
+        auto const imbalance = [](Candidate const & c){return std::max(c.Bought, c.Sold) - std::min(c.Bought, c.Sold);};
+        auto best = Candidate{0, 0, 0};
+        for (auto const & c : candidates) if (volume(c) > volume(best)) best = c;
+        if (volume(best)==0) return;
+        for (auto const & c : candidates)
+        {
+            if (volume(c)==volume(best) && imbalance(c) < imbalance(best)) best = c;
+        }
+        auto tied       = std::vector<Candidate>();
+        auto buyersOver = std::vector<Candidate>();
+        for (auto const & c : candidates)
+        {
+            if (volume(c) != volume(best) || imbalance(c) != imbalance(best)) continue;
+            tied.push_back(c);
+            if (c.Bought > c.Sold) buyersOver.push_back(c);
+        }
+        auto const & finalists = buyersOver.empty() ? tied : buyersOver;
+        auto chosen = finalists.front();
+        for (auto const & c : finalists)
+        {
+            if (buyersOver.empty() ? c.Price < chosen.Price : c.Price > chosen.Price) chosen = c;
+        }
+
+        //bids and asks in priority order, each side filled front to back
+        auto remaining = volume(chosen);
+        while (remaining > 0)
+        {
+            auto & bid = mBids.begin()->second.front();
+            auto & ask = mAsks.begin()->second.front();
+            auto const quantity = std::min(std::min(bid.Quantity, ask.Quantity), remaining);
+            printTrade(bid.ID, chosen.Price, ask.ID, chosen.Price, quantity, reports);
+            remaining -= quantity;
+            fillFront(mBids, quantity);
+            fillFront(mAsks, quantity);
+        }
+    }
+    Candidate candidate(price_t price) const
+    {
+        auto bought = uint64_t(0);
+        auto sold   = uint64_t(0);
+        for (auto const & level : mBids) if (level.first >= price) for (auto const & o : level.second) bought += o.Quantity;
+        for (auto const & level : mAsks) if (level.first <= price) for (auto const & o : level.second) sold   += o.Quantity;
+        return Candidate{price, bought, sold};
+    }
+    template <typename BookType>
+    void fillFront(BookType & bookSide, uint64_t quantity)
+    {
+        auto const best = bookSide.begin();
+        auto & order = best->second.front();
+        order.Quantity -= quantity;
+        if (order.Quantity != 0) return;
+        mOrderFinders.erase(order.ID);
+        best->second.erase(best->second.begin());
+        if (best->second.empty()) bookSide.erase(best);
+    }
+    void endSession()
+    {
+        mBids.clear();
+        mAsks.clear();
+        mOrderFinders.clear();
+        mCollecting = false;
+    }
+    void printBook(std::ostream & reports) const
+    {
+        reports << "SELL:\n";
+        for (auto iter = mAsks.rbegin(); iter != mAsks.rend(); ++iter) printLevel(iter->first, iter->second, reports);
+        reports << "BUY:\n";
+        for (auto iter = mBids.begin(); iter != mBids.end(); ++iter) printLevel(iter->first, iter->second, reports);
+    }
+    static void printLevel(price_t price, order_vector_t const & level, std::ostream & reports)
+    {
+        auto totalQuantity = uint64_t(0);
+        for (auto const & o : level) totalQuantity += o.Quantity;
+        reports << price << " " << totalQuantity << "\n";
+    }
+    static void printTrade(std::string const & bookID, price_t bookPrice, std::string const & newID, price_t newPrice,
+                           uint64_t quantity, std::ostream & reports)
+    {
+        reports << "TRADE " << bookID << " " << bookPrice << " " << quantity << " "
+        << newID << " " << newPrice << " " << quantity << "\n";
+    }
+
+    bid_book_t                    mBids;
+    ask_book_t                    mAsks;
+    std::map<std::string, Finder> mOrderFinders;
+    uint64_t                      mSequence;   //orders numbered as they arrive
+    bool                          mCollecting; //between AUCTION and UNCROSS
+};
+
+#endif
@@ -0,0 +1,261 @@
+#include <iostream>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+
+#include "matchingengine.h"
+#include "referencebook.h"
+#include "flowgenerator.h"
+
+//replaydiff [--seed=S] [--seeds=N] [--messages=N] [--depth=D] [--spread=T] [--cross=T]
+//           [--auctions=K] [--sessions=K] [--shrink=0|1] [--shrink-out=FILE] [file]
+//runs the same message stream through ReferenceBook (referencebook.h) and the
+//engine as built (make BOOK=ladder checks the ladder book, make STATS=1 the
+//instrumented one), comparing every message's trades and book prints; a stream
+//is a recorded text file, or one seeded flow (see flowgenerator.h) per seed from
+//S on, with an AUCTION every K messages (and its UNCROSS K later) and an
+//END_OF_DAY every K; prints each stream's first divergence, if any, and each
+//variant's msgs/sec, then shrinks a diverging stream to a minimal one that still
+//diverges (into --shrink-out when given); exits 1 if any stream diverged
+
+namespace
+{
+using bench_clock_t = std::chrono::steady_clock;
+using stream_t      = std::vector<std::string>;
+
+bool parseOption(char const * arg, char const * name, char const * & value)
+{
+    auto const length = std::strlen(name);
+    if (std::strncmp(arg, name, length) != 0 || arg[length] != '=') return false;
+    value = arg + length + 1;
+    return true;
+}
+
+struct StringReportSink : ExecutionReportSink
+{//TextReportSink's lines, kept for comparing
+    void trade(TradeEvent const & trade, OrderIdTable const & orderIds) override
+    {
+        appendTrade(mOutput, trade, orderIds);
+        mOutput.append('\n');
+    }
+    void bookSide(OrderSide side) override
+    {
+        appendBookSide(mOutput, side);
+        mOutput.append('\n');
+    }
+    void bookLevel(price_t price, uint64_t quantity) override
+    {
+        appendBookLevel(mOutput, price, quantity);
+        mOutput.append('\n');
+    }
+    std::string text() const {return std::string(mOutput.data(), mOutput.size());}
+    void clear() {mOutput.clear();}
+
+    StringReportSink():mOutput(){}
+    StringReportSink(StringReportSink const &)             = delete;
+    StringReportSink & operator=(StringReportSink const &) = delete;
+    ~StringReportSink(){}
+private:
+    MemoryOutput mOutput;
+};
+
+struct Divergence
+{
+    bool        Found;
+    std::size_t Message;   //index into the stream
+    std::string Reference; //what each side reported for it
+    std::string Engine;
+};
+
+Divergence compare(stream_t const & messages)
+{//both variants from empty, message by message, up to the first difference
+    ReferenceBook reference;
+    StringReportSink sink;
+    MatchingEngine engine(sink);
+    engine.setSessionLog(nullptr);
+    auto expected = std::ostringstream();
+    for (auto i = std::size_t(0); i < messages.size(); ++i)
+    {
+        expected.str("");
+        sink.clear();
+        reference.processMessage(messages[i], expected);
+        engine.processNextMessage(messages[i]);
+        if (expected.str() != sink.text()) return Divergence{true, i, expected.str(), sink.text()};
+    }
+    return Divergence{false, 0, std::string(), std::string()};
+}
+
+double referenceRate(stream_t const & messages)
+{//msgs/sec, formatting reports but keeping none
+    ReferenceBook reference;
+    auto reports = std::ostringstream();
+    auto const start = bench_clock_t::now();
+    for (auto const & message : messages)
+    {
+        reference.processMessage(message, reports);
+        reports.str("");
+    }
+    return messages.size()/std::chrono::duration<double>(bench_clock_t::now() - start).count();
+}
+
+double engineRate(stream_t const & messages)
+{
+    StringReportSink sink;
+    MatchingEngine engine(sink);
+    engine.setSessionLog(nullptr);
+    auto const start = bench_clock_t::now();
+    for (auto const & message : messages)
+    {
+        engine.processNextMessage(message);
+        sink.clear();
+    }
+    return messages.size()/std::chrono::duration<double>(bench_clock_t::now() - start).count();
+}
+
+stream_t shrink(stream_t messages)
+{//ddmin over the stream, which already diverges at its last message: drop ever
+    //smaller chunks for as long as what is left still diverges somewhere
+    auto chunks = std::size_t(2);
+    while (messages.size() >= 2)
+    {
+        auto const size = messages.size();
+        auto dropped = false;
+        for (auto c = std::size_t(0); c < chunks && !dropped; ++c)
+        {
+            auto const begin = size*c/chunks;
+            auto const end   = size*(c + 1)/chunks;
+            auto rest = stream_t(messages.begin(), messages.begin() + begin);
+            rest.insert(rest.end(), messages.begin() + end, messages.end());
+            auto const divergence = compare(rest);
+            if (!divergence.Found) continue;
+            rest.resize(divergence.Message + 1); //anything after the divergence can go too
+            messages = rest;
+            chunks   = std::max(chunks - 1, std::size_t(2));
+            dropped  = true;
+        }
+        if (dropped) continue;
+        if (chunks >= size) break;
+        chunks = std::min(chunks*2, size);
+    }
+    return messages;
+}
+
+stream_t generate(FlowConfig const & config, std::size_t count, std::size_t auctionEvery, std::size_t sessionEvery)
+{
+    auto generator = FlowGenerator(config);
+    auto messages  = stream_t();
+    auto const add = [&messages](FlowGenerator::Messages const & flow)
+    {
+        for (auto i = std::size_t(0); i < flow.size(); ++i) messages.push_back(flow.at(i).str());
+    };
+    add(generator.warmup());
+    auto const flow = generator.generate(count);
+    auto collecting = false;
+    for (auto i = std::size_t(0); i < flow.size(); ++i)
+    {
+        if (auctionEvery != 0 && i % auctionEvery==0 && i != 0)
+        {
+            messages.push_back(collecting ? "UNCROSS" : "AUCTION");
+            collecting = !collecting;
+        }
+        if (sessionEvery != 0 && i % sessionEvery==0 && i != 0) messages.push_back("END_OF_DAY");
+        messages.push_back(flow.at(i).str());
+    }
+    return messages;
+}
+
+bool readStream(char const * path, stream_t & messages)
+{
+    auto file = std::ifstream(path);
+    if (!file) return false;
+    for (auto line = std::string(); std::getline(file, line);) if (!line.empty()) messages.push_back(line);
+    return true;
+}
+
+void printReports(std::string const & name, std::string const & reports)
+{
+    std::cout << "  " << name << (reports.empty() ? ": nothing" : ":") << std::endl;
+    auto lines = std::istringstream(reports);
+    for (auto line = std::string(); std::getline(lines, line);) std::cout << "    " << line << std::endl;
+}
+
+bool check(std::string const & name, stream_t const & messages, bool shrinking, char const * shrinkOut)
+{//true if the variants agreed throughout
+    auto const divergence = compare(messages);
+    std::cout << name << ": " << messages.size() << " messages, ";
+    if (!divergence.Found) std::cout << "identical";
+    else std::cout << "first divergence at message " << divergence.Message << ": " << messages[divergence.Message];
+    std::cout << "; reference " << static_cast<uint64_t>(referenceRate(messages)) << " msgs/s, engine "
+    << static_cast<uint64_t>(engineRate(messages)) << " msgs/s" << std::endl;
+    if (!divergence.Found) return true;
+    printReports("reference", divergence.Reference);
+    printReports("engine", divergence.Engine);
+    if (!shrinking) return false;
+
+    auto const minimal = shrink(stream_t(messages.begin(), messages.begin() + divergence.Message + 1));
+    std::cout << "  shrunk to " << minimal.size() << " messages:" << std::endl;
+    for (auto const & message : minimal) std::cout << "    " << message << std::endl;
+    if (shrinkOut)
+    {
+        auto file = std::ofstream(shrinkOut);
+        for (auto const & message : minimal) file << message << '\n';
+    }
+    return false;
+}
+}
+
+int main(int argc, char ** argv)
+{
+  auto config       = defaultFlowConfig();
+  auto seeds        = std::size_t(10);
+  auto count        = std::size_t(100000);
+  auto auctionEvery = std::size_t(1000);
+  auto sessionEvery = std::size_t(25000);
+  auto shrinking    = true;
+  auto shrinkOut    = static_cast<char const *>(nullptr);
+  auto path         = static_cast<char const *>(nullptr);
+  for (auto i = 1; i < argc; ++i)
+  {
+    auto value = static_cast<char const *>(nullptr);
+    auto ok    = true;
+    if      (parseOption(argv[i], "--seed", value))       config.Seed   = std::strtoull(value, nullptr, 10);
+    else if (parseOption(argv[i], "--seeds", value))      seeds         = std::strtoull(value, nullptr, 10);
+    else if (parseOption(argv[i], "--messages", value))   count         = std::strtoull(value, nullptr, 10);
+    else if (parseOption(argv[i], "--depth", value))      config.Depth  = std::strtoull(value, nullptr, 10);
+    else if (parseOption(argv[i], "--spread", value))     config.Spread = static_cast<unsigned>(std::strtoul(value, nullptr, 10));
+    else if (parseOption(argv[i], "--cross", value))      config.Cross  = static_cast<unsigned>(std::strtoul(value, nullptr, 10));
+    else if (parseOption(argv[i], "--auctions", value))   auctionEvery  = std::strtoull(value, nullptr, 10);
+    else if (parseOption(argv[i], "--sessions", value))   sessionEvery  = std::strtoull(value, nullptr, 10);
+    else if (parseOption(argv[i], "--shrink", value))     shrinking     = std::strtoul(value, nullptr, 10) != 0;
+    else if (parseOption(argv[i], "--shrink-out", value)) shrinkOut     = value;
+    else if (argv[i][0] != '-' && !path)                  path          = argv[i];
+    else ok = false;
+    if (!ok || config.Spread==0)
+    {
+      std::cerr << "bad argument " << argv[i] << std::endl;
+      return 1;
+    }
+  }
+
+  auto agreed = true;
+  if (path)
+  {
+    auto messages = stream_t();
+    if (!readStream(path, messages))
+    {
+      std::cerr << "cannot read " << path << std::endl;
+      return 1;
+    }
+    agreed = check(path, messages, shrinking, shrinkOut);
+  }
+  else for (auto s = std::size_t(0); s < seeds; ++s, ++config.Seed)
+  {
+    auto const messages = generate(config, count, auctionEvery, sessionEvery);
+    agreed = check("seed " + std::to_string(config.Seed), messages, shrinking, shrinkOut) && agreed;
+  }
+  return agreed ? 0 : 1;
+}
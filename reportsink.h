@@ -0,0 +1,299 @@
+#ifndef MATCHINGENGINE_REPORTSINK_H
+#define MATCHINGENGINE_REPORTSINK_H
+
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "objectsemantics.h"
+#include "ordertypes.h"
+#include "orderindex.h"
+
+//the book doesn't format anything itself; it hands structured events to an
+//ExecutionReportSink, and the sink decides what they look like and when they
+//leave the process
+
+struct TradeEvent
+{//one fill; the book order always came first, except in an auction uncross,
+    //where BookOrder is the buy, NewOrder the sell, and both prices the clearing price
+    order_handle_t BookOrder;
+    order_handle_t NewOrder;
+    price_t        BookPrice;
+    price_t        NewPrice;
+    uint64_t       Quantity;
+};
+
+struct ExecutionReportSink
+{//a PRINT arrives as bookSide(Sell), its levels high to low, then bookSide(Buy) and its levels
+    virtual void trade(TradeEvent const & trade, OrderIdTable const & orderIds) = 0;
+    virtual void bookSide(OrderSide side) = 0;
+    virtual void bookLevel(price_t price, uint64_t quantity) = 0;
+    virtual void endOfMessage() {} //called once every input message has been handled
+    virtual void flush() {}
+    virtual ~ExecutionReportSink(){}
+};
+
+enum class FlushPolicy : uint8_t
+{
+    EveryEvent,   //each report line goes out as soon as it's written
+    EveryMessage, //whatever a message produced goes out before the next message; for interactive use
+    WhenFull      //only when the buffer fills, and on flush(); for replays and pipes
+};
+
+inline std::size_t formatUnsigned(uint64_t value, char (&digits)[20])
+{//digits are produced backwards into the end of the array; returns where they start
+    auto first = sizeof(digits);
+    do
+    {
+        digits[--first] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    return first;
+}
+
+struct OutputBuffer
+{//a large reusable buffer in front of a FILE, so many small reports become few writes
+    static constexpr std::size_t DefaultBufferSize = 1 << 16;
+
+    void append(char const * data, std::size_t size)
+    {
+        if (mUsed + size > mBuffer.size())
+        {
+            drain();
+            if (size > mBuffer.size())
+            {
+                std::fwrite(data, 1, size, mOutput);
+                return;
+            }
+        }
+        std::memcpy(mBuffer.data() + mUsed, data, size);
+        mUsed += size;
+    }
+    void append(char c)
+    {
+        if (mUsed==mBuffer.size()) drain();
+        mBuffer[mUsed++] = c;
+    }
+    void appendUnsigned(uint64_t value)
+    {
+        char digits[20];
+        auto const first = formatUnsigned(value, digits);
+        append(digits + first, sizeof(digits) - first);
+    }
+    void drain()
+    {
+        if (mUsed != 0) std::fwrite(mBuffer.data(), 1, mUsed, mOutput);
+        mUsed = 0;
+    }
+    void flush()
+    {
+        drain();
+        std::fflush(mOutput);
+    }
+
+    explicit OutputBuffer(std::FILE * output, std::size_t bufferSize = DefaultBufferSize)
+    :mOutput(output), mBuffer(bufferSize), mUsed(0){}
+    OutputBuffer(OutputBuffer const &)             = delete;
+    OutputBuffer & operator=(OutputBuffer const &) = delete;
+    ~OutputBuffer(){}
+private:
+    std::FILE *       mOutput;
+    std::vector<char> mBuffer;
+    std::size_t       mUsed;
+};
+
+struct MemoryOutput
+{//OutputBuffer's appends, kept in memory until the owner takes them
+    void append(char const * data, std::size_t size) {mText.insert(mText.end(), data, data + size);}
+    void append(char c) {mText.push_back(c);}
+    void appendUnsigned(uint64_t value)
+    {
+        char digits[20];
+        auto const first = formatUnsigned(value, digits);
+        append(digits + first, sizeof(digits) - first);
+    }
+    char const * data()  const {return mText.data();}
+    std::size_t  size()  const {return mText.size();}
+    void         clear()       {mText.clear();}
+
+    MemoryOutput():mText(){}
+    DEFAULT_OBJECT_SEMANTICS(MemoryOutput)
+    ~MemoryOutput(){}
+private:
+    std::vector<char> mText;
+};
+
+//the original line format, without the newline: TRADE bookId bookPrice qty newId newPrice qty,
+//and for a PRINT "SELL:"/"BUY:" headers followed by "price quantity" lines; Output
+//is anything with OutputBuffer's appends
+template <typename Output>
+void appendOrderID(Output & output, order_handle_t orderID, OrderIdTable const & orderIds)
+{//handles that came in pre-assigned (binary protocol) have no text, so print the number
+    if (orderIds.contains(orderID))
+    {
+        auto const name = orderIds.name(orderID);
+        output.append(name.Data, name.Size);
+    }
+    else output.appendUnsigned(orderID);
+}
+template <typename Output>
+void appendTrade(Output & output, TradeEvent const & trade, OrderIdTable const & orderIds)
+{
+    output.append("TRADE ", 6);
+    appendOrderID(output, trade.BookOrder, orderIds);
+    output.append(' ');
+    output.appendUnsigned(trade.BookPrice);
+    output.append(' ');
+    output.appendUnsigned(trade.Quantity);
+    output.append(' ');
+    appendOrderID(output, trade.NewOrder, orderIds);
+    output.append(' ');
+    output.appendUnsigned(trade.NewPrice);
+    output.append(' ');
+    output.appendUnsigned(trade.Quantity);
+}
+template <typename Output>
+void appendBookSide(Output & output, OrderSide side)
+{
+    if (side==OrderSide::Sell) output.append("SELL:", 5);
+    else                       output.append("BUY:", 4);
+}
+template <typename Output>
+void appendBookLevel(Output & output, price_t price, uint64_t quantity)
+{
+    output.appendUnsigned(price);
+    output.append(' ');
+    output.appendUnsigned(quantity);
+}
+
+struct TextReportSink : ExecutionReportSink
+{//the text line format above, one report per line
+    void trade(TradeEvent const & trade, OrderIdTable const & orderIds) override
+    {
+        appendTrade(mOutput, trade, orderIds);
+        endLine();
+    }
+    void bookSide(OrderSide side) override
+    {
+        appendBookSide(mOutput, side);
+        endLine();
+    }
+    void bookLevel(price_t price, uint64_t quantity) override
+    {
+        appendBookLevel(mOutput, price, quantity);
+        endLine();
+    }
+    void endOfMessage() override {if (mPolicy==FlushPolicy::EveryMessage) mOutput.flush();}
+    void flush()        override {mOutput.flush();}
+
+    explicit TextReportSink(std::FILE * output, FlushPolicy policy = FlushPolicy::WhenFull)
+    :mOutput(output), mPolicy(policy){}
+    TextReportSink(TextReportSink const &)             = delete; //sinks are handed out by reference, so they stay put
+    TextReportSink & operator=(TextReportSink const &) = delete;
+    ~TextReportSink(){mOutput.flush();}
+private:
+    void endLine()
+    {
+        mOutput.append('\n');
+        if (mPolicy==FlushPolicy::EveryEvent) mOutput.flush();
+    }
+
+    OutputBuffer mOutput;
+    FlushPolicy  mPolicy;
+};
+
+//binary reports are fixed-size little-endian records, in the spirit of binaryprotocol.h
+//
+//  offset size field
+//       0    1 type          (ReportType)
+//       1    1 side          (OrderSide; BookSide)
+//       2    2 reserved      (zero)
+//       4    4 book order    (Trade)
+//       8    4 new order     (Trade)
+//      12    4 reserved      (zero)
+//      16    8 quantity      (Trade/BookLevel)
+//      24    8 price         (Trade: the book order's; BookLevel)
+//      32    8 new price     (Trade)
+//
+//ids are written as handles; the text names stay with the engine's OrderIdTable
+
+enum class ReportType : uint8_t {Trade = 1, BookSide = 2, BookLevel = 3};
+
+struct ReportCodec
+{
+    static constexpr std::size_t RecordSize = 40;
+
+    static void encodeTrade(TradeEvent const & trade, unsigned char * record)
+    {
+        std::memset(record, 0, RecordSize);
+        record[0] = static_cast<unsigned char>(ReportType::Trade);
+        store(record +  4, trade.BookOrder, 4);
+        store(record +  8, trade.NewOrder,  4);
+        store(record + 16, trade.Quantity,  8);
+        store(record + 24, trade.BookPrice, 8);
+        store(record + 32, trade.NewPrice,  8);
+    }
+    static void encodeBookSide(OrderSide side, unsigned char * record)
+    {
+        std::memset(record, 0, RecordSize);
+        record[0] = static_cast<unsigned char>(ReportType::BookSide);
+        record[1] = static_cast<unsigned char>(side);
+    }
+    static void encodeBookLevel(price_t price, uint64_t quantity, unsigned char * record)
+    {
+        std::memset(record, 0, RecordSize);
+        record[0] = static_cast<unsigned char>(ReportType::BookLevel);
+        store(record + 16, quantity, 8);
+        store(record + 24, price,    8);
+    }
+private:
+    static void store(unsigned char * out, uint64_t value, std::size_t width)
+    {
+        for (auto i = std::size_t(0); i < width; ++i) out[i] = static_cast<unsigned char>(value >> (8*i));
+    }
+};
+
+struct BinaryReportSink : ExecutionReportSink
+{//always flushes only when full; binary reports are for files and pipes, not terminals
+    void trade(TradeEvent const & trade, OrderIdTable const &) override
+    {
+        unsigned char record[ReportCodec::RecordSize];
+        ReportCodec::encodeTrade(trade, record);
+        write(record);
+    }
+    void bookSide(OrderSide side) override
+    {
+        unsigned char record[ReportCodec::RecordSize];
+        ReportCodec::encodeBookSide(side, record);
+        write(record);
+    }
+    void bookLevel(price_t price, uint64_t quantity) override
+    {
+        unsigned char record[ReportCodec::RecordSize];
+        ReportCodec::encodeBookLevel(price, quantity, record);
+        write(record);
+    }
+    void flush() override {mOutput.flush();}
+
+    explicit BinaryReportSink(std::FILE * output):mOutput(output){}
+    BinaryReportSink(BinaryReportSink const &)             = delete;
+    BinaryReportSink & operator=(BinaryReportSink const &) = delete;
+    ~BinaryReportSink(){mOutput.flush();}
+private:
+    void write(unsigned char const * record)
+    {
+        mOutput.append(reinterpret_cast<char const *>(record), ReportCodec::RecordSize);
+    }
+
+    OutputBuffer mOutput;
+};
+
+struct NullReportSink : ExecutionReportSink
+{//drops everything; for measuring the book without any output cost
+    void trade(TradeEvent const &, OrderIdTable const &) override {}
+    void bookSide(OrderSide) override {}
+    void bookLevel(price_t, uint64_t) override {}
+};
+
+#endif
@@ -0,0 +1,205 @@
+#include <iostream>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "matchingengine.h"
+#include "shardedengine.h"
+#include "flowgenerator.h"
+
+//shardbench [--symbols=N] [--zipf=S] [--workers=1,2,4] [--messages=N] [--seed=S]
+//           [--depth=D] [--reports=null|text] [--pin]
+//spreads a seeded flow (see flowgenerator.h) over N symbols, with symbol r (from 0)
+//drawing messages in proportion to 1/(r + 1)^S; every symbol's book is filled to
+//--depth orders untimed, then the flow runs once on one thread with no rings at all,
+//and once through a ShardedEngine per worker count, timed until its last report is
+//written; text reports go to /dev/null
+
+namespace
+{
+using bench_clock_t = std::chrono::steady_clock;
+
+bool parseOption(char const * arg, char const * name, char const * & value)
+{
+    auto const length = std::strlen(name);
+    if (std::strncmp(arg, name, length) != 0 || arg[length] != '=') return false;
+    value = arg + length + 1;
+    return true;
+}
+
+bool parseCounts(char const * text, std::vector<std::size_t> & counts)
+{
+    counts.clear();
+    for (;;)
+    {
+        auto end = static_cast<char *>(nullptr);
+        auto const count = std::strtoull(text, &end, 10);
+        if (end==text || count==0) return false;
+        counts.push_back(count);
+        if (*end=='\0') return true;
+        if (*end != ',') return false;
+        text = end + 1;
+    }
+}
+
+struct SymbolFlow
+{//every symbol's messages, already prefixed, and the order to send them in
+    FlowGenerator::Messages  Warmup;
+    FlowGenerator::Messages  Messages;
+    std::vector<std::size_t> SymbolOf; //the symbol of each of Messages, for the single thread run
+};
+
+void append(FlowGenerator::Messages & out, std::string const & prefix, Token const & message, FlowMessage type)
+{
+    out.Text.insert(out.Text.end(), prefix.begin(), prefix.end());
+    out.Text.insert(out.Text.end(), message.Data, message.Data + message.Size);
+    out.Offsets.push_back(out.Text.size());
+    out.Types.push_back(type);
+}
+
+SymbolFlow makeFlow(FlowConfig const & config, std::size_t symbols, double exponent, std::size_t count)
+{//draws the symbol of every message first, then has each symbol's generator make
+    //that many, so each symbol's flow is the one a single book benchmark would see
+    auto random = FlowRandom(config.Seed);
+    auto const zipf = ZipfDistribution(symbols, exponent);
+    auto flow = SymbolFlow();
+    flow.SymbolOf.reserve(count);
+    auto perSymbol = std::vector<std::size_t>(symbols, 0);
+    for (auto i = std::size_t(0); i < count; ++i)
+    {
+        flow.SymbolOf.push_back(zipf(random));
+        ++perSymbol[flow.SymbolOf.back()];
+    }
+    auto warmups  = std::vector<FlowGenerator::Messages>();
+    auto messages = std::vector<FlowGenerator::Messages>();
+    for (auto s = std::size_t(0); s < symbols; ++s)
+    {
+        auto symbolConfig = config;
+        symbolConfig.Seed = config.Seed + s + 1;
+        auto generator = FlowGenerator(symbolConfig);
+        warmups.push_back(generator.warmup());
+        messages.push_back(generator.generate(perSymbol[s]));
+    }
+    flow.Warmup.Offsets.push_back(0);
+    for (auto s = std::size_t(0); s < symbols; ++s)
+    {
+        auto const prefix = "S" + std::to_string(s) + " ";
+        for (auto i = std::size_t(0); i < warmups[s].size(); ++i) append(flow.Warmup, prefix, warmups[s].at(i), warmups[s].Types[i]);
+    }
+    flow.Messages.Offsets.reserve(count + 1);
+    flow.Messages.Offsets.push_back(0);
+    auto next = std::vector<std::size_t>(symbols, 0);
+    for (auto const s : flow.SymbolOf)
+    {
+        auto const i = next[s]++;
+        append(flow.Messages, "S" + std::to_string(s) + " ", messages[s].at(i), messages[s].Types[i]);
+    }
+    return flow;
+}
+
+Token body(Token const & message)
+{//the message past its symbol
+    auto const space = static_cast<char const *>(std::memchr(message.Data, ' ', message.Size));
+    return Token(space + 1, message.Size - static_cast<std::size_t>(space + 1 - message.Data));
+}
+}
+
+int main(int argc, char ** argv)
+{
+  auto config   = defaultFlowConfig();
+  config.Depth  = 20;
+  auto count    = std::size_t(2000000);
+  auto symbols  = std::size_t(2000);
+  auto exponent = 1.0;
+  auto workers  = std::vector<std::size_t>{1, 2, 4};
+  auto reports  = "null";
+  auto pin      = false;
+  for (auto i = 1; i < argc; ++i)
+  {
+    auto value = static_cast<char const *>(nullptr);
+    auto ok    = true;
+    if      (parseOption(argv[i], "--messages", value)) count        = std::strtoull(value, nullptr, 10);
+    else if (parseOption(argv[i], "--symbols", value))  symbols      = std::strtoull(value, nullptr, 10);
+    else if (parseOption(argv[i], "--zipf", value))     exponent     = std::strtod(value, nullptr);
+    else if (parseOption(argv[i], "--workers", value))  ok           = parseCounts(value, workers);
+    else if (parseOption(argv[i], "--seed", value))     config.Seed  = std::strtoull(value, nullptr, 10);
+    else if (parseOption(argv[i], "--depth", value))    config.Depth = std::strtoull(value, nullptr, 10);
+    else if (parseOption(argv[i], "--reports", value))  reports      = value;
+    else if (std::strcmp(argv[i], "--pin")==0)          pin          = true;
+    else ok = false;
+    if (!ok)
+    {
+      std::cerr << "bad argument " << argv[i] << std::endl;
+      return 1;
+    }
+  }
+  auto const text = std::strcmp(reports, "text")==0;
+  if (symbols==0 || (!text && std::strcmp(reports, "null") != 0))
+  {
+    std::cerr << "need at least one symbol, and null or text reports" << std::endl;
+    return 1;
+  }
+  auto devNull = std::fopen("/dev/null", "wb");
+  if (!devNull)
+  {
+    std::cerr << "could not open /dev/null" << std::endl;
+    return 1;
+  }
+
+  auto const flow = makeFlow(config, symbols, exponent, count);
+  auto shards = defaultShardConfig();
+  shards.Band = PriceBand{config.Mid - config.Spread - config.Cross, 2*(config.Spread + config.Cross) + 1};
+  shards.Pin  = pin;
+
+  std::cout << "flow: seed " << config.Seed << " messages " << count << " symbols " << symbols
+  << " zipf " << exponent << " depth " << config.Depth << " per symbol, reports " << reports
+  << ", " << std::thread::hardware_concurrency() << " cpus" << std::endl;
+
+  auto baseline = 0.0;
+  {//one thread, every book called directly: what the rings and threads have to beat
+    auto sink = std::unique_ptr<ExecutionReportSink>();
+    if (text) sink.reset(new TextReportSink(devNull));
+    else      sink.reset(new NullReportSink());
+    auto engines = std::vector<std::unique_ptr<MatchingEngine>>();
+    for (auto s = std::size_t(0); s < symbols; ++s)
+      engines.emplace_back(new MatchingEngine(*sink, shards.Band, shards.OrdersPerSymbol));
+    for (auto i = std::size_t(0); i < flow.Warmup.size(); ++i) engines[i/config.Depth]->processNextMessage(body(flow.Warmup.at(i)));
+    auto const start = bench_clock_t::now();
+    for (auto i = std::size_t(0); i < flow.Messages.size(); ++i)
+      engines[flow.SymbolOf[i]]->processNextMessage(body(flow.Messages.at(i)));
+    sink->flush();
+    auto const seconds = std::chrono::duration<double>(bench_clock_t::now() - start).count();
+    baseline = flow.Messages.size()/seconds;
+    std::cout << "single thread: " << static_cast<uint64_t>(baseline) << " msgs/s" << std::endl;
+  }
+  for (auto const n : workers)
+  {
+    shards.Workers = n;
+    ShardedEngine engine(shards, text ? devNull : nullptr);
+    for (auto i = std::size_t(0); i < flow.Warmup.size(); ++i) engine.processNextMessage(flow.Warmup.at(i));
+    engine.drain();
+    auto before = std::vector<uint64_t>();
+    for (auto w = std::size_t(0); w < n; ++w) before.push_back(engine.workerMessages(w));
+    auto const start = bench_clock_t::now();
+    for (auto i = std::size_t(0); i < flow.Messages.size(); ++i) engine.processNextMessage(flow.Messages.at(i));
+    engine.finish();
+    auto const seconds = std::chrono::duration<double>(bench_clock_t::now() - start).count();
+    auto const rate    = flow.Messages.size()/seconds;
+    auto busiest = uint64_t(0);
+    for (auto w = std::size_t(0); w < n; ++w)
+    {
+      auto const messages = engine.workerMessages(w) - before[w];
+      if (messages > busiest) busiest = messages;
+    }
+    std::cout << "workers " << n << ": " << static_cast<uint64_t>(rate) << " msgs/s, "
+    << rate/baseline << "x single thread, busiest worker " << 100.0*busiest/flow.Messages.size()
+    << "% of messages" << std::endl;
+  }
+
+  std::fclose(devNull);
+  return 0;
+}
@@ -0,0 +1,315 @@
+#ifndef MATCHINGENGINE_SHARDEDENGINE_H
+#define MATCHINGENGINE_SHARDEDENGINE_H
+
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "messagereader.h"
+#include "reportsink.h"
+#include "orderindex.h"
+#include "matchingengine.h"
+#include "spscring.h"
+
+//many symbols on many threads: every input line is "SYMBOL MESSAGE", e.g.
+//"AAPL BUY GFD 1000 10 order1", and the router (the caller's thread) hands it to
+//the worker that owns SYMBOL's book over that worker's SpscRing; a worker owns its
+//books outright and runs them one message at a time, so matching takes no locks
+//
+//symbols are given to workers round robin as they first appear, and stay put.
+//Report lines are led by their symbol ("AAPL TRADE ..."), and a merger thread
+//writes each message's reports in input order, so the output is exactly what
+//one thread running every book would write, whatever the number of workers;
+//the books' END_OF_DAY, UNCROSS and STATS lines are led by their symbol too, and
+//go the same way to the merger's log, rather than to stderr from every worker
+
+//every book's ladder is allocated up front, so a full default band (megabytes a
+//book) is far too much for thousands of them; they get a narrow one instead, and
+//prices outside it go sparse
+#ifndef MATCHINGENGINE_SHARD_TICKS
+#define MATCHINGENGINE_SHARD_TICKS (1 << 8)
+#endif
+
+struct ShardConfig
+{
+    std::size_t Workers;
+    std::size_t RingSlots;       //per ring; a slot carries up to TextSlot::TextCapacity bytes of text
+    std::size_t OrdersPerSymbol; //each book's initial order pool
+    PriceBand   Band;            //each book's ladder band; MATCHINGENGINE_SHARD_TICKS from MATCHINGENGINE_LADDER_LOW by default
+    bool        Pin;             //pin worker i to cpu i (Linux only)
+};
+
+inline ShardConfig defaultShardConfig()
+{//books start small; of thousands of symbols, most only ever hold a few orders
+    return ShardConfig{1, 1 << 12, 1 << 12, PriceBand{MATCHINGENGINE_LADDER_LOW, MATCHINGENGINE_SHARD_TICKS}, false};
+}
+
+struct SymbolReportSink : ExecutionReportSink
+{//TextReportSink's lines, each led by the symbol, gathered in the worker's buffer
+    void trade(TradeEvent const & trade, OrderIdTable const & orderIds) override
+    {
+        startLine();
+        appendTrade(*mOutput, trade, orderIds);
+        mOutput->append('\n');
+    }
+    void bookSide(OrderSide side) override
+    {
+        startLine();
+        appendBookSide(*mOutput, side);
+        mOutput->append('\n');
+    }
+    void bookLevel(price_t price, uint64_t quantity) override
+    {
+        startLine();
+        appendBookLevel(*mOutput, price, quantity);
+        mOutput->append('\n');
+    }
+
+    SymbolReportSink(Token const & symbol, MemoryOutput & output):mPrefix(symbol.str() + ' '), mOutput(&output){}
+    SymbolReportSink(SymbolReportSink const &)             = delete;
+    SymbolReportSink & operator=(SymbolReportSink const &) = delete;
+    ~SymbolReportSink(){}
+private:
+    void startLine() {mOutput->append(mPrefix.data(), mPrefix.size());}
+
+    std::string    mPrefix;
+    MemoryOutput * mOutput;
+};
+
+struct ShardedEngine
+{
+    void processNextMessage(Token const & message)
+    {//routes one "SYMBOL MESSAGE" line; blank lines are skipped
+        if (message.Size==0) return;
+        auto const space  = static_cast<char const *>(std::memchr(message.Data, ' ', message.Size));
+        auto const symbol = Token(message.Data, space ? static_cast<std::size_t>(space - message.Data) : message.Size);
+        auto const id     = mSymbols.intern(symbol);
+        if (id==NoOrderHandle) return; //more symbols than there are ids
+        if (id==mRoutes.size())
+        {
+            auto const worker = static_cast<uint32_t>(id % mWorkers.size());
+            mRoutes.push_back(Route{worker, mBooksPerWorker[worker]++});
+        }
+        auto const route = mRoutes[id];
+        sendText(mWorkers[route.Worker]->Input, route.Book, message.Data, message.Size);
+        ++mRouted[route.Worker];
+        if (mOutput)
+        {
+            mOrder.claimWait() = route.Worker;
+            mOrder.publish();
+        }
+    }
+    template <typename TextReader>
+    void processMessages(TextReader & reader)
+    {//as MatchingEngine's
+        auto message = Token();
+        while (reader.nextMessage(message)) processNextMessage(message);
+    }
+    void drain()
+    {//waits until the workers have matched every message routed so far; their
+        //reports may still be on the way to the output
+        for (auto w = std::size_t(0); w < mWorkers.size(); ++w)
+        {
+            auto backoff = Backoff();
+            while (mWorkers[w]->Messages.load(std::memory_order_acquire) != mRouted[w]) backoff.pause();
+        }
+    }
+    void finish()
+    {//waits until every routed message has been matched and its reports written;
+        //nothing more can be routed afterwards
+        if (mFinished) return;
+        mFinished = true;
+        for (auto & worker : mWorkers)
+        {
+            auto & slot = worker->Input.claimWait();
+            slot.Size   = TextSlot::Stop;
+            worker->Input.publish();
+        }
+        if (mOutput)
+        {
+            mOrder.claimWait() = NoWorker;
+            mOrder.publish();
+        }
+        for (auto & worker : mWorkers) worker->Thread.join();
+        if (mMerger.joinable()) mMerger.join();
+    }
+    std::size_t symbols() const {return mSymbols.size();}
+    std::size_t workers() const {return mWorkers.size();}
+    uint64_t workerMessages(std::size_t worker) const {return mRouted[worker];}
+
+    //output receives the merged reports (nullptr drops them, and there is no merger);
+    //policy is when it's flushed, EveryMessage meaning whenever the merger catches up;
+    //log receives the merged session lines, flushed as they come, or none without output
+    ShardedEngine(ShardConfig const & config, std::FILE * output, FlushPolicy policy = FlushPolicy::WhenFull,
+                  std::FILE * log = stderr)
+    :mConfig(config), mSymbols(), mRoutes(), mBooksPerWorker(config.Workers ? config.Workers : 1, 0),
+    mRouted(mBooksPerWorker.size(), 0), mWorkers(),
+    mOrder(config.RingSlots*mBooksPerWorker.size()), mOutput(output), mLog(log), mPolicy(policy), mMergeScratch(), mMerger(),
+    mFinished(false)
+    {
+        for (auto i = std::size_t(0); i < mBooksPerWorker.size(); ++i)
+        {
+            mWorkers.emplace_back(new Worker(config.RingSlots, output != nullptr));
+            auto & worker  = *mWorkers.back();
+            worker.Thread  = std::thread([this, &worker]{runWorker(worker);});
+            if (config.Pin) pin(worker.Thread, i);
+        }
+        if (mOutput) mMerger = std::thread([this]{runMerger();});
+    }
+    ShardedEngine(ShardedEngine const &)             = delete; //the threads hold on to it
+    ShardedEngine & operator=(ShardedEngine const &) = delete;
+    ~ShardedEngine(){finish();}
+private:
+    static constexpr uint32_t NoWorker = uint32_t(-1); //ends the merger
+
+    struct Route
+    {
+        uint32_t Worker;
+        uint32_t Book;
+    };
+
+    struct Worker
+    {//everything here but Input's producer side belongs to the worker's thread
+        struct Book
+        {
+            std::string                          Prefix; //its symbol and a space, to lead its session lines
+            std::unique_ptr<ExecutionReportSink> Reports;
+            std::unique_ptr<MatchingEngine>      Engine;
+        };
+
+        text_ring_t      Input;
+        text_ring_t      Output;   //each message's reports, to the merger; empty rings when dropping them
+        std::vector<Book> Books;    //indexed by Route::Book
+        MemoryOutput      Reports;  //the current message's
+        std::ostringstream Log;     //the current message's session lines, as the engine writes them
+        bool              Merged;
+        std::vector<char>     Scratch;
+        std::atomic<uint64_t> Messages; //matched so far, for drain()
+        std::thread           Thread;
+
+        Worker(std::size_t ringSlots, bool merged)
+        :Input(ringSlots), Output(merged ? ringSlots : 1), Books(), Reports(), Log(), Merged(merged), Scratch(),
+        Messages(0), Thread(){}
+    };
+
+    void runWorker(Worker & worker)
+    {
+        for (;;)
+        {
+            auto & first = worker.Input.frontWait();
+            if (first.Size==TextSlot::Stop)
+            {
+                worker.Input.pop();
+                return;
+            }
+            auto const book    = first.Tag; //the router tags each message with its book's index
+            auto inPlace       = false;
+            auto const message = receiveText(worker.Input, first, worker.Scratch, inPlace);
+            auto const space   = static_cast<char const *>(std::memchr(message.Data, ' ', message.Size));
+            if (book==worker.Books.size()) addBook(worker, Token(message.Data, space ? static_cast<std::size_t>(space - message.Data) : message.Size));
+            auto const body = space ? Token(space + 1, message.Size - static_cast<std::size_t>(space + 1 - message.Data)) : Token(message.Data, 0);
+            worker.Books[book].Engine->processNextMessage(body);
+            if (inPlace) worker.Input.pop();
+            worker.Messages.store(worker.Messages.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            if (worker.Merged)
+            {//one entry per message, even an empty one, so the merger can keep count; its
+                //tag says where the reports end and any session lines begin
+                auto const reports = static_cast<uint32_t>(worker.Reports.size());
+                if (worker.Log.tellp() > 0) appendLog(worker, worker.Books[book].Prefix);
+                sendText(worker.Output, reports, worker.Reports.data(), worker.Reports.size());
+                worker.Reports.clear();
+            }
+        }
+    }
+    static void appendLog(Worker & worker, std::string const & prefix)
+    {//the session lines after the reports, each led by the symbol
+        auto const text = worker.Log.str();
+        worker.Log.str("");
+        for (auto begin = std::size_t(0); begin < text.size();)
+        {
+            auto end = text.find('\n', begin);
+            end = (end==std::string::npos) ? text.size() : end + 1;
+            worker.Reports.append(prefix.data(), prefix.size());
+            worker.Reports.append(text.data() + begin, end - begin);
+            begin = end;
+        }
+    }
+    void addBook(Worker & worker, Token const & symbol)
+    {
+        auto reports = std::unique_ptr<ExecutionReportSink>();
+        if (worker.Merged) reports.reset(new SymbolReportSink(symbol, worker.Reports));
+        else               reports.reset(new NullReportSink());
+        auto engine = std::unique_ptr<MatchingEngine>(new MatchingEngine(*reports, mConfig.Band, mConfig.OrdersPerSymbol));
+        engine->setSessionLog(worker.Merged ? &worker.Log : nullptr);
+        worker.Books.push_back(Worker::Book{symbol.str() + ' ', std::move(reports), std::move(engine)});
+    }
+    void runMerger()
+    {//the router logs which worker each message went to, so reports come out in input order
+        OutputBuffer output(mOutput);
+        for (;;)
+        {
+            auto next = mOrder.front();
+            if (!next)
+            {
+                if (mPolicy != FlushPolicy::WhenFull) output.flush();
+                next = &mOrder.frontWait();
+            }
+            auto const worker = *next;
+            mOrder.pop();
+            if (worker==NoWorker) break;
+            auto & ring        = mWorkers[worker]->Output;
+            auto & first       = ring.frontWait();
+            auto const split   = std::size_t(first.Tag);
+            auto inPlace       = false;
+            auto const reports = receiveText(ring, first, mMergeScratch, inPlace);
+            output.append(reports.Data, split);
+            if (reports.Size > split && mLog)
+            {
+                std::fwrite(reports.Data + split, 1, reports.Size - split, mLog);
+                std::fflush(mLog);
+            }
+            if (inPlace) ring.pop();
+        }
+        output.flush();
+    }
+    static void pin(std::thread & thread, std::size_t index)
+    {
+#ifdef __linux__
+        auto const cpus = std::thread::hardware_concurrency();
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpus ? index % cpus : 0, &set);
+        pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#else
+        (void)thread;
+        (void)index;
+#endif
+    }
+
+    ShardConfig                          mConfig;
+    OrderIdTable                         mSymbols;        //symbols interned like order ids, into dense ids
+    std::vector<Route>                   mRoutes;         //indexed by symbol id
+    std::vector<uint32_t>                mBooksPerWorker; //books handed out so far
+    std::vector<uint64_t>                mRouted;         //messages sent to each worker
+    std::vector<std::unique_ptr<Worker>> mWorkers;
+    SpscRing<uint32_t>                   mOrder;          //the worker of every routed message, in input order
+    std::FILE *                          mOutput;
+    std::FILE *                          mLog;
+    FlushPolicy                          mPolicy;
+    std::vector<char>                    mMergeScratch;
+    std::thread                          mMerger;
+    bool                                 mFinished;
+};
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef MATCHINGENGINE_SLABPOOL_H
+#define MATCHINGENGINE_SLABPOOL_H
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <type_traits>
+#include <cstdint>
+
+#include "objectsemantics.h"
+
+using pool_index_t = uint32_t;
+
+constexpr pool_index_t NoPoolIndex = pool_index_t(-1);
+
+struct PoolStats
+{
+    std::size_t ElementSize;
+    std::size_t Capacity;   //elements preallocated across all slabs
+    std::size_t Live;       //elements currently handed out
+    std::size_t HighWater;  //most ever live at once
+    std::size_t Slabs;
+    std::size_t Growths;    //slabs added after construction; nonzero means the pool was undersized
+};
+
+inline std::ostream & operator<<(std::ostream & os, PoolStats const & stats)
+{
+    return os << "capacity "   << stats.Capacity
+              << " live "      << stats.Live
+              << " highwater " << stats.HighWater
+              << " slabs "     << stats.Slabs
+              << " growths "   << stats.Growths
+              << " bytes "     << stats.Capacity*stats.ElementSize;
+}
+
+template <typename T>
+struct SlabPool
+{//fixed-size slabs of trivially copyable T, addressed by a 32-bit index; released
+    //elements go on a free stack and are reused first, then the slabs are handed
+    //out in address order from a bump index, so once the pool has seen its
+    //high-water mark nothing is allocated or freed; slabs never move, so
+    //references stay valid for as long as the element is live
+    //reset() gives every element back at once, in O(1): the slabs stay for the
+    //next session, which starts bumping from the first slab again
+    static_assert(std::is_trivially_copyable<T>::value, "SlabPool elements are never constructed or destroyed");
+    static constexpr std::size_t SlabShift = 12;
+    static constexpr std::size_t SlabSize  = std::size_t(1) << SlabShift;
+
+    pool_index_t allocate()
+    {
+        auto index = NoPoolIndex;
+        if (!mFree.empty())
+        {
+            index = mFree.back();
+            mFree.pop_back();
+        }
+        else
+        {
+            if (mNext==mSlabs.size()*SlabSize) addSlab();
+            index = static_cast<pool_index_t>(mNext++);
+        }
+        if (++mLive > mHighWater) mHighWater = mLive;
+        return index;
+    }
+    void release(pool_index_t index)
+    {
+        mFree.push_back(index);
+        --mLive;
+    }
+    void reset()
+    {//every element released, and the high-water mark starts again
+        mFree.clear();
+        mNext      = 0;
+        mLive      = 0;
+        mHighWater = 0;
+    }
+    T       & operator[](pool_index_t index)       {return mSlabs[index >> SlabShift][index & (SlabSize - 1)];}
+    T const & operator[](pool_index_t index) const {return mSlabs[index >> SlabShift][index & (SlabSize - 1)];}
+    void prefetch(pool_index_t index) const {__builtin_prefetch(&(*this)[index]);}
+
+    PoolStats stats() const
+    {
+        return PoolStats{sizeof(T), mSlabs.size()*SlabSize, mLive, mHighWater, mSlabs.size(), mGrowths};
+    }
+
+    explicit SlabPool(std::size_t initialCapacity)
+    :mSlabs(), mFree(), mNext(0), mLive(0), mHighWater(0), mGrowths(0)
+    {
+        auto const slabs = (initialCapacity + SlabSize - 1)/SlabSize;
+        for (auto i = std::size_t(0); i < slabs; ++i) mSlabs.emplace_back(new T[SlabSize]);
+        mFree.reserve(slabs*SlabSize);
+    }
+    DEFAULT_OBJECT_SEMANTICS(SlabPool)
+    ~SlabPool(){}
+private:
+    void addSlab()
+    {
+        mSlabs.emplace_back(new T[SlabSize]);
+        mFree.reserve(mSlabs.size()*SlabSize); //so release never allocates
+        ++mGrowths;
+    }
+
+    std::vector<std::unique_ptr<T[]>> mSlabs;
+    std::vector<pool_index_t>         mFree;
+    std::size_t                       mNext;      //first index not yet handed out this session
+    std::size_t                       mLive;
+    std::size_t                       mHighWater;
+    std::size_t                       mGrowths;
+};
+
+#endif
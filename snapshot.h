@@ -0,0 +1,148 @@
+#ifndef MATCHINGENGINE_SNAPSHOT_H
+#define MATCHINGENGINE_SNAPSHOT_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <unistd.h>
+
+#include "orderbook.h"
+#include "mappedfile.h"
+
+//a snapshot is the whole book plus the journal position it corresponds to, so
+//recovery is: load the snapshot, then replay the journal from that position on
+//
+//  offset size field
+//       0    8 magic            ("MESNAP02")
+//       8    8 journal position (bytes of journal already reflected here)
+//      16    8 handle count     (handles the session has handed out; the next new id gets this one)
+//      24    8 id count         (the text ids of resting orders, in handle order)
+//      32    8 order count
+//      40      ids: handle(4) reserved(4) length(8), then the id zero padded to a multiple of 8
+//              orders, bids best to worst then asks, each level front to back:
+//                price(8) quantity(8) handle(4) side(1) tif(1) reserved(2)
+//     end    8 trailer          ("MESNAPOK"; a snapshot without one is ignored)
+//
+//an id whose order has gone isn't kept: its handle is left unheld on loading, and
+//if a later order takes it up again the journal names it (see MatchingEngine::journal)
+//
+//snapshots are written to a temporary file and renamed over the old one, so
+//there is always one complete snapshot to recover from
+
+namespace snapshot_detail
+{
+constexpr std::size_t HeaderSize      = 40;
+constexpr std::size_t IdHeaderSize    = 16;
+constexpr std::size_t OrderRecordSize = 24;
+
+inline void store(std::vector<unsigned char> & out, uint64_t value, std::size_t width)
+{
+    for (auto i = std::size_t(0); i < width; ++i) out.push_back(static_cast<unsigned char>(value >> (8*i)));
+}
+inline uint64_t load(unsigned char const * in, std::size_t width)
+{
+    auto value = uint64_t(0);
+    for (auto i = std::size_t(0); i < width; ++i) value |= uint64_t(in[i]) << (8*i);
+    return value;
+}
+}
+
+inline bool writeSnapshot(OrderBook const & book, char const * path, uint64_t journalPosition)
+{
+    using namespace snapshot_detail;
+    auto const & orderIds = book.orderIds();
+    auto handles = std::vector<order_handle_t>();
+    book.forEachRestingOrder([&handles, &orderIds](Order const & order)
+    {
+        if (orderIds.contains(order.ID)) handles.push_back(order.ID);
+    });
+    std::sort(handles.begin(), handles.end());
+    handles.erase(std::unique(handles.begin(), handles.end()), handles.end());
+
+    auto bytes = std::vector<unsigned char>();
+    bytes.insert(bytes.end(), "MESNAP02", "MESNAP02" + 8);
+    store(bytes, journalPosition,            8);
+    store(bytes, orderIds.size(),            8);
+    store(bytes, handles.size(),             8);
+    store(bytes, book.orderPoolStats().Live, 8);
+    for (auto const handle : handles)
+    {
+        auto const name = orderIds.name(handle);
+        store(bytes, handle,    4);
+        store(bytes, 0,         4);
+        store(bytes, name.Size, 8);
+        bytes.insert(bytes.end(), name.Data, name.Data + name.Size);
+        bytes.resize((bytes.size() + 7) & ~std::size_t(7), 0);
+    }
+    book.forEachRestingOrder([&bytes](Order const & order)
+    {
+        store(bytes, order.Price,    8);
+        store(bytes, order.Quantity, 8);
+        store(bytes, order.ID,       4);
+        bytes.push_back(static_cast<unsigned char>(order.Side));
+        bytes.push_back(static_cast<unsigned char>(order.TIF));
+        bytes.push_back(0);
+        bytes.push_back(0);
+    });
+    bytes.insert(bytes.end(), "MESNAPOK", "MESNAPOK" + 8);
+
+    auto const temporary = std::string(path) + ".tmp";
+    auto file = std::fopen(temporary.c_str(), "wb");
+    if (!file) return false;
+    auto ok = std::fwrite(bytes.data(), 1, bytes.size(), file)==bytes.size();
+    ok = (std::fflush(file)==0) && ok;
+    ok = (::fsync(fileno(file))==0) && ok;
+    ok = (std::fclose(file)==0) && ok;
+    return ok && std::rename(temporary.c_str(), path)==0;
+}
+
+inline bool loadSnapshot(OrderBook & book, MappedFile const & snapshot, uint64_t & journalPosition)
+{//into an empty book; false, with the book untouched, if the snapshot is incomplete
+    using namespace snapshot_detail;
+    auto const data = snapshot.data();
+    auto const size = snapshot.size();
+    if (size < HeaderSize + 8 || std::memcmp(data, "MESNAP02", 8) != 0 || std::memcmp(data + size - 8, "MESNAPOK", 8) != 0) return false;
+    auto const handleCount = load(data + 16, 8);
+    auto const idCount     = load(data + 24, 8);
+    auto const orderCount  = load(data + 32, 8);
+
+    //check the whole layout, and rebuild the ids aside, before changing anything
+    auto orderIds = OrderIdTable();
+    auto position = HeaderSize;
+    auto const end = size - 8;
+    for (auto i = uint64_t(0); i < idCount; ++i)
+    {
+        if (end - position < IdHeaderSize) return false;
+        auto const handle = static_cast<order_handle_t>(load(data + position, 4));
+        auto const length = load(data + position + 8, 8);
+        if (length > end - position - IdHeaderSize) return false;
+        auto const orderID = Token(reinterpret_cast<char const *>(data + position + IdHeaderSize), static_cast<std::size_t>(length));
+        if (!orderIds.restore(handle, orderID)) return false;
+        position += IdHeaderSize + ((static_cast<std::size_t>(length) + 7) & ~std::size_t(7));
+        if (position > end) return false;
+    }
+    if (orderIds.size() > handleCount || !orderIds.advance(handleCount)) return false;
+    if ((end - position)/OrderRecordSize != orderCount || (end - position)%OrderRecordSize != 0) return false;
+
+    book.orderIds() = std::move(orderIds);
+    for (auto i = uint64_t(0); i < orderCount; ++i, position += OrderRecordSize)
+    {
+        auto order     = Order();
+        order.Price    = load(data + position,      8);
+        order.Quantity = load(data + position +  8, 8);
+        order.ID       = static_cast<order_handle_t>(load(data + position + 16, 4));
+        order.Side     = static_cast<OrderSide>(data[position + 20]);
+        order.TIF      = static_cast<TimeInForce>(data[position + 21]);
+        order.Prev     = NoPoolIndex;
+        order.Next     = NoPoolIndex;
+        book.restoreOrder(order);
+    }
+    journalPosition = load(data + 8, 8);
+    return true;
+}
+
+#endif
@@ -0,0 +1,174 @@
+#ifndef MATCHINGENGINE_SPSCRING_H
+#define MATCHINGENGINE_SPSCRING_H
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "messagereader.h"
+
+//a bounded single-producer single-consumer ring: each side owns one index and
+//only reads the other's, so handing work between two threads never takes a lock
+//
+//slots are written and read in place: the producer claim()s a slot, fills it and
+//publish()es it; the consumer reads front() and pop()s it when done with it. Either
+//side can batch instead: stage() or consume() slots one by one, and make them
+//visible to the other side with one flush() or release(); a side that has to wait
+//always makes its own batch visible first, so batching can't deadlock the pair
+
+struct Backoff
+{//spin briefly, then start giving the core away; waiting threads may share a core
+    void pause()
+    {
+        if (++mSpins < SpinsBeforeYield)
+        {
+#if defined(__x86_64__) || defined(__i386__)
+            _mm_pause();
+#endif
+        }
+        else std::this_thread::yield();
+    }
+
+    Backoff():mSpins(0){}
+private:
+    static constexpr unsigned SpinsBeforeYield = 64;
+
+    unsigned mSpins;
+};
+
+template <typename T>
+struct SpscRing
+{
+    //producer side
+    T * claim()
+    {//the next free slot, or nullptr while the ring is full
+        if (mWrite - mHeadSeen == mSlots.size())
+        {
+            mHeadSeen = mHead.load(std::memory_order_acquire);
+            if (mWrite - mHeadSeen == mSlots.size()) return nullptr;
+        }
+        return &mSlots[mWrite & mMask];
+    }
+    T & claimWait()
+    {
+        auto backoff = Backoff();
+        for (;;)
+        {
+            if (auto const slot = claim()) return *slot;
+            flush();
+            backoff.pause();
+        }
+    }
+    void stage()   {++mWrite;}
+    void flush()   {if (mTail.load(std::memory_order_relaxed) != mWrite) mTail.store(mWrite, std::memory_order_release);}
+    void publish() {stage(); flush();}
+
+    //consumer side
+    T * front()
+    {//the oldest published slot, or nullptr while the ring is empty
+        if (mRead==mTailSeen)
+        {
+            mTailSeen = mTail.load(std::memory_order_acquire);
+            if (mRead==mTailSeen) return nullptr;
+        }
+        return &mSlots[mRead & mMask];
+    }
+    T & frontWait()
+    {
+        auto backoff = Backoff();
+        for (;;)
+        {
+            if (auto const slot = front()) return *slot;
+            release();
+            backoff.pause();
+        }
+    }
+    void consume() {++mRead;}
+    void release() {if (mHead.load(std::memory_order_relaxed) != mRead) mHead.store(mRead, std::memory_order_release);}
+    void pop()     {consume(); release();}
+
+    //capacity is rounded up to a power of two
+    explicit SpscRing(std::size_t capacity)
+    :mSlots(roundUp(capacity)), mMask(mSlots.size() - 1), mTail(0), mWrite(0), mHeadSeen(0), mHead(0), mRead(0), mTailSeen(0){}
+    SpscRing(SpscRing const &)             = delete; //the threads on either side hold on to it
+    SpscRing & operator=(SpscRing const &) = delete;
+    ~SpscRing(){}
+private:
+    static std::size_t roundUp(std::size_t capacity)
+    {
+        auto size = std::size_t(1);
+        while (size < capacity) size *= 2;
+        return size;
+    }
+
+    //padding keeps the producer's and the consumer's indices on separate cache lines
+    static constexpr std::size_t CacheLine = 64;
+
+    std::vector<T>           mSlots;
+    std::size_t              mMask;
+    char                     mPad0[CacheLine];
+    std::atomic<std::size_t> mTail;     //written by the producer: slots published
+    std::size_t              mWrite;    //producer's own: slots staged, published or not
+    std::size_t              mHeadSeen; //producer's last look at mHead
+    char                     mPad1[CacheLine];
+    std::atomic<std::size_t> mHead;     //written by the consumer: slots released
+    std::size_t              mRead;     //consumer's own: slots consumed, released or not
+    std::size_t              mTailSeen; //consumer's last look at mTail
+    char                     mPad2[CacheLine];
+};
+
+struct TextSlot
+{//a run of text in as many consecutive slots as it takes: the first has the
+    //total Size, and the text carries on through the rest
+    static constexpr std::size_t TextCapacity = 120;
+    static constexpr uint32_t    Stop         = uint32_t(-1); //a Size no text has, for signalling the end
+
+    uint32_t Tag; //whatever the sender wants to go along with the text
+    uint32_t Size;
+    char     Text[TextCapacity];
+};
+
+using text_ring_t = SpscRing<TextSlot>;
+
+inline void sendText(text_ring_t & ring, uint32_t tag, char const * data, std::size_t size)
+{
+    auto sent = std::size_t(0);
+    do
+    {
+        auto const chunk = (size - sent < TextSlot::TextCapacity) ? size - sent : TextSlot::TextCapacity;
+        auto & slot = ring.claimWait();
+        slot.Tag    = tag;
+        slot.Size   = static_cast<uint32_t>(size);
+        if (chunk != 0) std::memcpy(slot.Text, data + sent, chunk); //an empty message still takes its slot
+        ring.publish();
+        sent += chunk;
+    } while (sent < size);
+}
+
+inline Token receiveText(text_ring_t & ring, TextSlot const & first, std::vector<char> & scratch, bool & inPlace)
+{//the text sendText sent, starting at first (the ring's front): read in place if it
+    //fits one slot, and then the caller pops that slot once done with it; otherwise
+    //gathered into scratch, with every slot already popped
+    inPlace = first.Size <= TextSlot::TextCapacity;
+    if (inPlace) return Token(first.Text, first.Size);
+    auto const size = std::size_t(first.Size);
+    scratch.resize(size);
+    auto received = std::size_t(0);
+    for (auto slot = &first; ; slot = &ring.frontWait())
+    {
+        auto const chunk = (size - received < TextSlot::TextCapacity) ? size - received : TextSlot::TextCapacity;
+        std::memcpy(scratch.data() + received, slot->Text, chunk);
+        ring.pop();
+        received += chunk;
+        if (received==size) return Token(scratch.data(), size);
+    }
+}
+
+#endif
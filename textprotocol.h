@@ -0,0 +1,59 @@
+#ifndef MATCHINGENGINE_TEXTPROTOCOL_H
+#define MATCHINGENGINE_TEXTPROTOCOL_H
+
+#include "messagereader.h"
+#include "binaryprotocol.h"
+#include "orderindex.h"
+
+//the text protocol, decoded into the same Commands the binary one carries:
+//
+//  BUY|SELL GFD|IOC price quantity id
+//  MODIFY id BUY|SELL price quantity
+//  CANCEL id
+//  PRINT
+//  STATS
+//  END_OF_DAY
+//  AUCTION
+//  UNCROSS
+//
+//prices and quantities are plain unsigned decimals (see Token::toUnsigned); a new
+//order's id is interned into orderIds; MODIFY and CANCEL only look theirs up, and
+//one that was never seen (or a new id orderIds has no room for, a price or
+//quantity that doesn't parse, or any unknown message) decodes as CommandType(0),
+//which the engine ignores
+
+inline Command decodeTextMessage(message_tokens_t const & messageTokens, OrderIdTable & orderIds)
+{
+    auto const & leadToken = messageTokens.front();
+    auto command = Command();
+    if (leadToken=="BUY" || leadToken=="SELL")
+    {//numbers first, so a malformed order doesn't take an id
+        if (!messageTokens.at(2).toUnsigned(command.Price) || !messageTokens.at(3).toUnsigned(command.Quantity)) return command;
+        command.OrderHandle = orderIds.intern(messageTokens.at(4));
+        if (command.OrderHandle==NoOrderHandle) return command;
+        command.Type        = (leadToken=="BUY") ? CommandType::Buy : CommandType::Sell;
+        command.Side        = (leadToken=="BUY") ? OrderSide::Buy   : OrderSide::Sell;
+        command.TIF         = (messageTokens.at(1)=="GFD") ? TimeInForce::GFD : TimeInForce::IOC;
+    }
+    else if (leadToken=="MODIFY" || leadToken=="CANCEL")
+    {
+        command.OrderHandle = orderIds.find(messageTokens.at(1));
+        if (command.OrderHandle==NoOrderHandle) return command;
+        if (leadToken=="CANCEL")
+        {
+            command.Type = CommandType::Cancel;
+            return command;
+        }
+        if (!messageTokens.at(3).toUnsigned(command.Price) || !messageTokens.at(4).toUnsigned(command.Quantity)) return command;
+        command.Type        = CommandType::Modify;
+        command.Side        = (messageTokens.at(2)=="BUY") ? OrderSide::Buy : OrderSide::Sell;
+    }
+    else if (leadToken=="PRINT") command.Type = CommandType::Print;
+    else if (leadToken=="STATS") command.Type = CommandType::Stats;
+    else if (leadToken=="END_OF_DAY") command.Type = CommandType::EndOfDay;
+    else if (leadToken=="AUCTION") command.Type = CommandType::Auction;
+    else if (leadToken=="UNCROSS") command.Type = CommandType::Uncross;
+    return command;
+}
+
+#endif
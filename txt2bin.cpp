@@ -0,0 +1,51 @@
+#include <iostream>
+#include <string>
+#include <cstdio>
+
+#include "messagereader.h"
+#include "binaryprotocol.h"
+#include "textprotocol.h"
+#include "orderindex.h"
+
+//txt2bin [input [output]]
+//converts a text message log into binary records for `matchingengine --binary`,
+//decoded by the engine's own decodeTextMessage (see textprotocol.h), so both
+//protocols read the text the same way; order ids are replaced by dense handles
+//in order of first appearance, starting again after each END_OF_DAY as the
+//engine's do; the engine reports trades by handle on the binary path, so trade
+//ids read as those numbers
+
+int main(int argc, char ** argv)
+{
+  auto input  = stdin;
+  auto output = stdout;
+  if (argc > 1 && !(input = std::fopen(argv[1], "rb")))
+  {
+    std::cerr << "could not open " << argv[1] << std::endl;
+    return 1;
+  }
+  if (argc > 2 && !(output = std::fopen(argv[2], "wb")))
+  {
+    std::cerr << "could not open " << argv[2] << std::endl;
+    return 1;
+  }
+
+  MessageReader reader(input);
+  auto tokens   = message_tokens_t();
+  auto orderIds = OrderIdTable();
+  auto message  = Token();
+  unsigned char record[BinaryCodec::RecordSize];
+  while (reader.nextMessage(message))
+  {
+    tokens.tokenize(message.Data, message.Size);
+    auto const command = decodeTextMessage(tokens, orderIds);
+    if (command.Type==CommandType(0)) continue; //the engine would ignore it anyway
+    BinaryCodec::encode(command, record);
+    std::fwrite(record, 1, sizeof(record), output);
+    if (command.Type==CommandType::EndOfDay) orderIds.clear();
+  }
+
+  if (input  != stdin)  std::fclose(input);
+  if (output != stdout) std::fclose(output);
+  return 0;
+}
@@ -0,0 +1,192 @@
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+
+#include "matchingengine.h"
+#include "bookview.h"
+#include "flowgenerator.h"
+#include "latencyhistogram.h"
+
+//viewbench [--messages=N] [--seed=S] [--depth=D] [--levels=L] [--readers=0,1,2,4] [--interval=NS]
+//runs a seeded flow (see flowgenerator.h) on a fresh engine several times, timing
+//every processNextMessage call: once with no book view, then publishing a
+//SeqlockBookView of --levels levels a side after every message, once per reader
+//count, with that many threads copying the view out flat out (or every --interval
+//ns); readers check that every copy they get is a sane, uncrossed book that never
+//goes back in time
+
+namespace
+{
+using bench_clock_t = std::chrono::steady_clock;
+
+bool parseOption(char const * arg, char const * name, char const * & value)
+{
+    auto const length = std::strlen(name);
+    if (std::strncmp(arg, name, length) != 0 || arg[length] != '=') return false;
+    value = arg + length + 1;
+    return true;
+}
+
+bool parseCounts(char const * text, std::vector<std::size_t> & counts)
+{//unlike the other benchmarks, 0 is a count here: a view with no readers
+    counts.clear();
+    for (;;)
+    {
+        auto end = static_cast<char *>(nullptr);
+        auto const count = std::strtoull(text, &end, 10);
+        if (end==text) return false;
+        counts.push_back(count);
+        if (*end=='\0') return true;
+        if (*end != ',') return false;
+        text = end + 1;
+    }
+}
+
+struct ReaderStats
+{
+    uint64_t Reads;
+    uint64_t Retries; //attempts a publish got in the way of
+    uint64_t Insane;  //copies that weren't a book; anything but 0 is a bug
+};
+
+bool sane(BookView const & view, uint64_t lastMessages)
+{//levels strictly worse as they go, none empty, the sides uncrossed
+    if (view.Messages < lastMessages) return false;
+    for (auto i = std::size_t(0); i < view.Bids.size(); ++i)
+    {
+        if (view.Bids[i].Quantity==0 || view.Bids[i].Orders==0) return false;
+        if (i != 0 && view.Bids[i].Price >= view.Bids[i - 1].Price) return false;
+    }
+    for (auto i = std::size_t(0); i < view.Asks.size(); ++i)
+    {
+        if (view.Asks[i].Quantity==0 || view.Asks[i].Orders==0) return false;
+        if (i != 0 && view.Asks[i].Price <= view.Asks[i - 1].Price) return false;
+    }
+    return view.Bids.empty() || view.Asks.empty() || view.Bids[0].Price < view.Asks[0].Price;
+}
+
+void runReader(SeqlockBookView const & view, std::atomic<bool> const & stop, long interval, ReaderStats & stats)
+{
+    auto copy = BookView(view.depth());
+    auto last = uint64_t(0);
+    while (!stop.load(std::memory_order_relaxed))
+    {
+        stats.Retries += view.read(copy);
+        ++stats.Reads;
+        if (!sane(copy, last)) ++stats.Insane;
+        last = copy.Messages;
+        if (interval != 0) std::this_thread::sleep_for(std::chrono::nanoseconds(interval));
+    }
+}
+
+struct Run
+{
+    std::string              Name;
+    LatencyHistogram         Latency; //ns per processNextMessage
+    double                   Seconds;
+    std::vector<ReaderStats> Readers;
+};
+
+void run(Run & result, FlowGenerator::Messages const & warmup, FlowGenerator::Messages const & messages,
+         std::size_t levels, bool publish, std::size_t readers, long interval)
+{
+    NullReportSink sink;
+    MatchingEngine engine(sink);
+    for (auto i = std::size_t(0); i < warmup.size(); ++i) engine.processNextMessage(warmup.at(i));
+    auto view = std::unique_ptr<SeqlockBookView>(publish ? new SeqlockBookView(levels) : nullptr);
+    engine.setBookView(view.get());
+    std::atomic<bool> stop(false);
+    auto threads = std::vector<std::thread>();
+    result.Readers.assign(readers, ReaderStats{0, 0, 0});
+    for (auto r = std::size_t(0); r < readers; ++r)
+    {
+        auto & stats = result.Readers[r];
+        threads.emplace_back([&view, &stop, interval, &stats]{runReader(*view, stop, interval, stats);});
+    }
+    auto const start = bench_clock_t::now();
+    for (auto i = std::size_t(0); i < messages.size(); ++i)
+    {
+        auto const before = bench_clock_t::now();
+        engine.processNextMessage(messages.at(i));
+        result.Latency.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock_t::now() - before).count()));
+    }
+    result.Seconds = std::chrono::duration<double>(bench_clock_t::now() - start).count();
+    stop.store(true, std::memory_order_relaxed);
+    for (auto & thread : threads) thread.join();
+}
+}
+
+int main(int argc, char ** argv)
+{
+  auto config   = defaultFlowConfig();
+  auto count    = std::size_t(1000000);
+  auto levels   = std::size_t(5);
+  auto readers  = std::vector<std::size_t>{0, 1, 2, 4};
+  auto interval = 0l;
+  for (auto i = 1; i < argc; ++i)
+  {
+    auto value = static_cast<char const *>(nullptr);
+    auto ok    = true;
+    if      (parseOption(argv[i], "--messages", value)) count        = std::strtoull(value, nullptr, 10);
+    else if (parseOption(argv[i], "--seed", value))     config.Seed  = std::strtoull(value, nullptr, 10);
+    else if (parseOption(argv[i], "--depth", value))    config.Depth = std::strtoull(value, nullptr, 10);
+    else if (parseOption(argv[i], "--levels", value))   levels       = std::strtoull(value, nullptr, 10);
+    else if (parseOption(argv[i], "--readers", value))  ok           = parseCounts(value, readers);
+    else if (parseOption(argv[i], "--interval", value)) interval     = std::strtol(value, nullptr, 10);
+    else ok = false;
+    if (!ok)
+    {
+      std::cerr << "bad argument " << argv[i] << std::endl;
+      return 1;
+    }
+  }
+  if (levels==0)
+  {
+    std::cerr << "need at least one level" << std::endl;
+    return 1;
+  }
+
+  auto generator = FlowGenerator(config);
+  auto const warmup   = generator.warmup();
+  auto const messages = generator.generate(count);
+
+  std::cout << "flow: seed " << config.Seed << " messages " << count << " depth " << config.Depth
+  << ", view of " << levels << " levels a side, readers every " << interval << " ns, "
+  << std::thread::hardware_concurrency() << " cpus" << std::endl;
+
+  auto runs = std::vector<Run>(readers.size() + 1);
+  runs[0].Name = "no view";
+  run(runs[0], warmup, messages, levels, false, 0, interval);
+  for (auto r = std::size_t(0); r < readers.size(); ++r)
+  {
+    runs[r + 1].Name = std::to_string(readers[r]) + " readers";
+    run(runs[r + 1], warmup, messages, levels, true, readers[r], interval);
+  }
+
+  printHistogramHeader(std::cout, "matcher (ns)");
+  for (auto const & r : runs) printHistogramRow(std::cout, r.Name.c_str(), r.Latency);
+  for (auto const & r : runs)
+  {
+    auto total = ReaderStats{0, 0, 0};
+    for (auto const & stats : r.Readers)
+    {
+      total.Reads   += stats.Reads;
+      total.Retries += stats.Retries;
+      total.Insane  += stats.Insane;
+    }
+    std::cout << r.Name << ": " << static_cast<uint64_t>(messages.size()/r.Seconds) << " msgs/s";
+    if (!r.Readers.empty())
+    {
+      std::cout << ", " << static_cast<uint64_t>(total.Reads/r.Seconds) << " reads/s, "
+      << (total.Reads ? double(total.Retries)/total.Reads : 0.0) << " retries/read, " << total.Insane << " insane";
+    }
+    std::cout << std::endl;
+  }
+  return 0;
+}